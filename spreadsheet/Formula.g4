@@ -25,5 +25,6 @@ ADD: '+' ;
 SUB: '-' ;
 MUL: '*' ;
 DIV: '/' ;
-CELL: [A-Z]+[0-9]+ ;
+// a reference to a deleted cell reads back as such
+CELL: [A-Z]+[0-9]+ | '#REF!' ;
 WS: [ \t\n\r]+ -> skip ;
\ No newline at end of file
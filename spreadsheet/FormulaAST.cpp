@@ -1,4 +1,6 @@
 #include <cassert>
+#include <cctype>
+#include <charconv>
 #include <cmath>
 #include <memory>
 #include <optional>
@@ -8,6 +10,7 @@
 #include "FormulaBaseListener.h"
 #include "FormulaLexer.h"
 #include "FormulaParser.h"
+#include "profiler.h"
 
 namespace ASTImpl {
     enum ExprPrecedence {
@@ -68,9 +71,13 @@ namespace ASTImpl {
     class Expr {
     public:
         virtual ~Expr() = default;
+        // cell references of the copy are added to cells
+        virtual std::unique_ptr<Expr> Clone(std::forward_list<CellReference>& cells, int row_offset, int col_offset) const = 0;
         virtual void Print(std::ostream& out) const = 0;
         virtual void DoPrintFormula(std::ostream& out, ExprPrecedence precedence) const = 0;
         virtual double Evaluate(const SheetInterface& spreadsheet) const = 0;
+        // appends the postfix steps of the subtree to the code, unless it is nullptr, and its slots to the loads
+        virtual void Compile(FormulaProgram::Code* code, std::vector<const CellReference*>& loads) const = 0;
 
         virtual ExprPrecedence GetPrecedence() const = 0;
 
@@ -94,6 +101,48 @@ namespace ASTImpl {
     };
 
     namespace {
+        // accepts the same texts as reading the whole of them with std::istream >> double,
+        // but without constructing a stream
+        std::optional<double> ConvertToNumber(std::string_view text) {
+            while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) {
+                text.remove_prefix(1);
+            }
+
+            std::string_view mantissa = text;
+            if (!mantissa.empty() && (mantissa.front() == '+' || mantissa.front() == '-')) {
+                mantissa.remove_prefix(1);
+            }
+
+            // rejects "inf", "nan" and a doubled sign, which the stream does not read either
+            if (mantissa.empty() || !(std::isdigit(static_cast<unsigned char>(mantissa.front())) 
+                || mantissa.front() == '.')) {
+
+                return std::nullopt;
+            }
+
+            if (text.front() == '+') {
+                text.remove_prefix(1);
+            }
+
+            double converted_value;
+            auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), converted_value);
+
+            if (ec != std::errc() || end != text.data() + text.size()) {
+                return std::nullopt;
+            }
+
+            return converted_value;
+        }
+
+        double ReadReference(const CellReference& reference, const SheetInterface& spreadsheet) {
+            if (!reference.pos.IsValid()) {
+                throw FormulaError(FormulaError::Category::Ref);
+            }
+
+            // only a formula not sitting in a cell has to look the position up
+            return ReadReferencedNumber(reference.cell != nullptr ? reference.cell : spreadsheet.GetCell(reference.pos));
+        }
+
         class BinaryOpExpr final : public Expr {
         public:
             enum Type : char {
@@ -110,6 +159,34 @@ namespace ASTImpl {
                 , rhs_(std::move(rhs)) {
             }
 
+            std::unique_ptr<Expr> Clone(std::forward_list<CellReference>& cells, int row_offset, int col_offset) const override {
+                auto lhs = lhs_->Clone(cells, row_offset, col_offset);
+                return std::make_unique<BinaryOpExpr>(type_, std::move(lhs), rhs_->Clone(cells, row_offset, col_offset));
+            }
+
+            void Compile(FormulaProgram::Code* code, std::vector<const CellReference*>& loads) const override {
+                lhs_->Compile(code, loads);
+                rhs_->Compile(code, loads);
+
+                if (code == nullptr) {
+                    return;
+                }
+
+                switch (type_) {
+                case Add:
+                    code->steps.push_back({ FormulaProgram::Op::Add });
+                    break;
+                case Subtract:
+                    code->steps.push_back({ FormulaProgram::Op::Subtract });
+                    break;
+                case Multiply:
+                    code->steps.push_back({ FormulaProgram::Op::Multiply });
+                    break;
+                case Divide:
+                    code->steps.push_back({ FormulaProgram::Op::Divide });
+                }
+            }
+
             void Print(std::ostream& out) const override {
                 out << '(' << static_cast<char>(type_) << ' ';
                 lhs_->Print(out);
@@ -144,17 +221,23 @@ namespace ASTImpl {
             double Evaluate(const SheetInterface& spreadsheet) const override {
                 double to_return = {};
 
-                switch (type_) {
-                case Add:
-                    to_return = lhs_->Evaluate(spreadsheet) + rhs_->Evaluate(spreadsheet);
-                    break;
-                case Subtract:
-                    to_return = lhs_->Evaluate(spreadsheet) - rhs_->Evaluate(spreadsheet);
-                    break;
-                case Multiply:
-                    to_return = lhs_->Evaluate(spreadsheet) * rhs_->Evaluate(spreadsheet);
-                    break;
-                case Divide:
+                // the left operand goes first, so that its error wins over the right one's
+                if (type_ != Divide) {
+                    const double lhs = lhs_->Evaluate(spreadsheet);
+                    const double rhs = rhs_->Evaluate(spreadsheet);
+
+                    switch (type_) {
+                    case Add:
+                        to_return = lhs + rhs;
+                        break;
+                    case Subtract:
+                        to_return = lhs - rhs;
+                        break;
+                    default:
+                        to_return = lhs * rhs;
+                    }
+                }
+                else {
                     double rhs = rhs_->Evaluate(spreadsheet);
 
                     if (rhs == 0) {
@@ -190,6 +273,18 @@ namespace ASTImpl {
                 , operand_(std::move(operand)) {
             }
 
+            std::unique_ptr<Expr> Clone(std::forward_list<CellReference>& cells, int row_offset, int col_offset) const override {
+                return std::make_unique<UnaryOpExpr>(type_, operand_->Clone(cells, row_offset, col_offset));
+            }
+
+            void Compile(FormulaProgram::Code* code, std::vector<const CellReference*>& loads) const override {
+                operand_->Compile(code, loads);
+
+                if (code != nullptr && type_ == UnaryMinus) {
+                    code->steps.push_back({ FormulaProgram::Op::Negate });
+                }
+            }
+
             void Print(std::ostream& out) const override {
                 out << '(' << static_cast<char>(type_) << ' ';
                 operand_->Print(out);
@@ -223,17 +318,38 @@ namespace ASTImpl {
 
         class CellExpr final : public Expr {
         public:
-            explicit CellExpr(Position* cell_reference)
+            explicit CellExpr(CellReference* cell_reference)
                 : cell_reference_(cell_reference) {
             }
 
+            std::unique_ptr<Expr> Clone(std::forward_list<CellReference>& cells, int row_offset, int col_offset) const override {
+                const Position pos = cell_reference_->pos;
+                Position moved = Position::NONE;
+
+                if (pos.IsValid()) {
+                    moved = { pos.row + row_offset, pos.col + col_offset };
+                }
+
+                cells.push_front({ moved.IsValid() ? moved : Position::NONE });
+                return std::make_unique<CellExpr>(&cells.front());
+            }
+
+            void Compile(FormulaProgram::Code* code, std::vector<const CellReference*>& loads) const override {
+                if (code != nullptr) {
+                    code->steps.push_back({ FormulaProgram::Op::Load, static_cast<std::uint32_t>(loads.size()) });
+                }
+
+                loads.push_back(cell_reference_);
+            }
+
             void Print(std::ostream& out) const override {
-                if (!cell_reference_->IsValid()) {
+                if (!cell_reference_->pos.IsValid()) {
                     out << FormulaError::Category::Ref;
                     return;
                 }
 
-                out << cell_reference_->ToString();
+                char buffer[Position::MAX_POSITION_LENGTH];
+                out.write(buffer, cell_reference_->pos.ToChars(buffer));
             }
 
             void DoPrintFormula(std::ostream& out, ExprPrecedence /* precedence */) const override {
@@ -245,31 +361,11 @@ namespace ASTImpl {
             }
 
             double Evaluate(const SheetInterface& spreadsheet) const override {
-                if (const CellInterface* taken_cell = spreadsheet.GetCell(*cell_reference_); taken_cell != nullptr) {
-                    auto value = taken_cell->GetValue();
-
-                    if (std::holds_alternative<FormulaError>(value)) {
-                        throw FormulaError(FormulaError::Category::Value);
-                    }
-                    else if (std::holds_alternative<std::string>(value)) {
-                        std::stringstream ss(std::get<std::string>(value));
-
-                        double converted_value;
-                        if (ss >> converted_value && ss.eof()) {
-                            return std::stod(std::get<std::string>(value));
-                        }
-
-                        throw FormulaError(FormulaError::Category::Value);
-                    }
-
-                    return std::get<double>(value);
-                }
-
-                return 0.0;
+                return ReadReference(*cell_reference_, spreadsheet);
             }
 
         private:
-            Position* cell_reference_;
+            CellReference* cell_reference_;
         };
 
         class NumberExpr final : public Expr {
@@ -278,6 +374,19 @@ namespace ASTImpl {
                 : value_(value) {
             }
 
+            std::unique_ptr<Expr> Clone(std::forward_list<CellReference>& /* cells */, int /* row_offset */,
+                int /* col_offset */) const override {
+
+                return std::make_unique<NumberExpr>(value_);
+            }
+
+            void Compile(FormulaProgram::Code* code, std::vector<const CellReference*>& /* loads */) const override {
+                if (code != nullptr) {
+                    code->steps.push_back({ FormulaProgram::Op::Constant, static_cast<std::uint32_t>(code->constants.size()) });
+                    code->constants.push_back(value_);
+                }
+            }
+
             void Print(std::ostream& out) const override {
                 out << value_;
             }
@@ -298,6 +407,138 @@ namespace ASTImpl {
             double value_;
         };
 
+        // the kernels evaluate the formulas of the most common shapes straight from their
+        // program, a reference or a number alone, negated or combined by one operation, with the
+        // same results and errors as the tree
+        using Op = FormulaProgram::Op;
+
+        template <Op kind>
+        double ReadOperand(const FormulaProgram& program, FormulaProgram::Step step, const SheetInterface& spreadsheet) {
+            if constexpr (kind == Op::Load) {
+                return ReadReference(*program.loads[step.operand], spreadsheet);
+            }
+            else {
+                return program.code->constants[step.operand];
+            }
+        }
+
+        template <Op kind>
+        double EvaluateOperand(const FormulaProgram& program, const SheetInterface& spreadsheet) {
+            return ReadOperand<kind>(program, program.code->steps[0], spreadsheet);
+        }
+
+        template <Op kind>
+        double EvaluateNegated(const FormulaProgram& program, const SheetInterface& spreadsheet) {
+            return -ReadOperand<kind>(program, program.code->steps[0], spreadsheet);
+        }
+
+        template <Op lhs_kind, Op op, Op rhs_kind>
+        double EvaluateBinary(const FormulaProgram& program, const SheetInterface& spreadsheet) {
+            const FormulaProgram::Step* steps = program.code->steps.data();
+            double result;
+
+            if constexpr (op == Op::Divide) {
+                const double rhs = ReadOperand<rhs_kind>(program, steps[1], spreadsheet);
+
+                if (rhs == 0) {
+                    throw FormulaError(FormulaError::Category::Arithmetic);
+                }
+
+                result = ReadOperand<lhs_kind>(program, steps[0], spreadsheet) / rhs;
+            }
+            else {
+                const double lhs = ReadOperand<lhs_kind>(program, steps[0], spreadsheet);
+                const double rhs = ReadOperand<rhs_kind>(program, steps[1], spreadsheet);
+
+                if constexpr (op == Op::Add) {
+                    result = lhs + rhs;
+                }
+                else if constexpr (op == Op::Subtract) {
+                    result = lhs - rhs;
+                }
+                else {
+                    result = lhs * rhs;
+                }
+            }
+
+            if (!std::isfinite(result)) {
+                throw FormulaError(FormulaError::Category::Arithmetic);
+            }
+
+            return result;
+        }
+
+        using Kernel = double (*)(const FormulaProgram& program, const SheetInterface& spreadsheet);
+
+        bool IsOperand(Op op) noexcept {
+            return op == Op::Load || op == Op::Constant;
+        }
+
+        template <Op lhs_kind, Op op>
+        Kernel SelectBinaryKernel(Op rhs_kind) noexcept {
+            return rhs_kind == Op::Load ? &EvaluateBinary<lhs_kind, op, Op::Load> : &EvaluateBinary<lhs_kind, op, Op::Constant>;
+        }
+
+        template <Op op>
+        Kernel SelectBinaryKernel(Op lhs_kind, Op rhs_kind) noexcept {
+            return lhs_kind == Op::Load ? SelectBinaryKernel<Op::Load, op>(rhs_kind) : SelectBinaryKernel<Op::Constant, op>(rhs_kind);
+        }
+
+        // nullptr for a formula of another shape, left to the tree
+        Kernel SelectKernel(const FormulaProgram::Code& code) noexcept {
+            const std::vector<FormulaProgram::Step>& steps = code.steps;
+
+            if (steps.empty() || !IsOperand(steps[0].op)) {
+                return nullptr;
+            }
+
+            const bool load = steps[0].op == Op::Load;
+
+            if (steps.size() == 1) {
+                return load ? &EvaluateOperand<Op::Load> : &EvaluateOperand<Op::Constant>;
+            }
+
+            if (steps.size() == 2 && steps[1].op == Op::Negate) {
+                return load ? &EvaluateNegated<Op::Load> : &EvaluateNegated<Op::Constant>;
+            }
+
+            if (steps.size() != 3 || !IsOperand(steps[1].op)) {
+                return nullptr;
+            }
+
+            switch (steps[2].op) {
+            case Op::Add:
+                return SelectBinaryKernel<Op::Add>(steps[0].op, steps[1].op);
+            case Op::Subtract:
+                return SelectBinaryKernel<Op::Subtract>(steps[0].op, steps[1].op);
+            case Op::Multiply:
+                return SelectBinaryKernel<Op::Multiply>(steps[0].op, steps[1].op);
+            case Op::Divide:
+                return SelectBinaryKernel<Op::Divide>(steps[0].op, steps[1].op);
+            default:
+                return nullptr;
+            }
+        }
+
+        template <Op op>
+        void EvaluateLanes(const double* lhs, const double* rhs, std::size_t count, double* results) noexcept {
+            for (std::size_t lane = 0; lane < count; ++lane) {
+                if constexpr (op == Op::Add) {
+                    results[lane] = lhs[lane] + rhs[lane];
+                }
+                else if constexpr (op == Op::Subtract) {
+                    results[lane] = lhs[lane] - rhs[lane];
+                }
+                else if constexpr (op == Op::Multiply) {
+                    results[lane] = lhs[lane] * rhs[lane];
+                }
+                else {
+                    // a division by zero is never finite, like the error the kernel throws
+                    results[lane] = lhs[lane] / rhs[lane];
+                }
+            }
+        }
+
         class ParseASTListener final : public FormulaBaseListener {
         public:
             std::unique_ptr<Expr> MoveRoot() {
@@ -308,7 +549,7 @@ namespace ASTImpl {
                 return root;
             }
 
-            std::forward_list<Position> MoveCells() {
+            std::forward_list<CellReference> MoveCells() {
                 return std::move(cells_);
             }
 
@@ -346,12 +587,14 @@ namespace ASTImpl {
 
             void exitCell(FormulaParser::CellContext* ctx) override {
                 auto valueStr = ctx->CELL()->getSymbol()->getText();
-                auto value = Position::FromString(valueStr);
-                if (!value.IsValid()) {
+                // the printed text of a reference to a deleted cell, which evaluates to #REF!
+                const bool deleted = valueStr == FormulaError(FormulaError::Category::Ref).ToString();
+                auto value = deleted ? Position::NONE : Position::FromString(valueStr);
+                if (!deleted && !value.IsValid()) {
                     throw FormulaException("Invalid position: " + valueStr);
                 }
 
-                cells_.push_front(value);
+                cells_.push_front({ value });
                 auto node = std::make_unique<CellExpr>(&cells_.front());
                 args_.push_back(std::move(node));
             }
@@ -389,7 +632,7 @@ namespace ASTImpl {
 
         private:
             std::vector<std::unique_ptr<Expr>> args_;
-            std::forward_list<Position> cells_;
+            std::forward_list<CellReference> cells_;
         };
 
         class BailErrorListener : public antlr4::BaseErrorListener {
@@ -434,31 +677,117 @@ FormulaAST ParseFormulaAST(const std::string& in_str) {
     return ParseFormulaAST(in);
 }
 
-FormulaAST::FormulaAST(std::unique_ptr<ASTImpl::Expr> root_expr, std::forward_list<Position> cells)
+FormulaAST::FormulaAST(std::unique_ptr<ASTImpl::Expr> root_expr, std::forward_list<CellReference> cells,
+    std::shared_ptr<const FormulaProgram::Code> code)
     : root_expr_(std::move(root_expr))
     , referenced_cells_(std::move(cells)) {
 
-    referenced_cells_.sort();
+    referenced_cells_.sort([](const CellReference& lhs, const CellReference& rhs) {
+        return lhs.pos < rhs.pos;
+    });
+
+    if (code != nullptr) {
+        root_expr_->Compile(nullptr, program_.loads);
+        program_.code = std::move(code);
+    }
+    else {
+        auto compiled = std::make_shared<FormulaProgram::Code>();
+        root_expr_->Compile(compiled.get(), program_.loads);
+        program_.code = std::move(compiled);
+    }
+
+    kernel_ = ASTImpl::SelectKernel(*program_.code);
 }
 
+FormulaAST::FormulaAST(FormulaAST&&) noexcept = default;
+FormulaAST& FormulaAST::operator=(FormulaAST&&) noexcept = default;
 FormulaAST::~FormulaAST() noexcept = default;
 
+FormulaAST FormulaAST::Clone(int row_offset, int col_offset) const {
+    std::forward_list<CellReference> cells;
+    auto root_expr = root_expr_->Clone(cells, row_offset, col_offset);
+
+    return FormulaAST(std::move(root_expr), std::move(cells), program_.code);
+}
+
 double FormulaAST::Execute(const SheetInterface& spreadsheet) const {
-    return root_expr_->Evaluate(spreadsheet);
+    return kernel_ != nullptr ? kernel_(program_, spreadsheet) : root_expr_->Evaluate(spreadsheet);
 }
 
-std::forward_list<Position>& FormulaAST::GetCells() noexcept {
+double FormulaAST::Execute(const SheetInterface& spreadsheet, Profiler& profiler) const {
+    profiler.CountFormulaExecution(kernel_ != nullptr, program_.code->steps.size());
+    return Execute(spreadsheet);
+}
+
+std::forward_list<CellReference>& FormulaAST::GetCells() noexcept {
     return referenced_cells_;
 }
 
-const std::forward_list<Position>& FormulaAST::GetCells() const noexcept {
+const std::forward_list<CellReference>& FormulaAST::GetCells() const noexcept {
     return referenced_cells_;
 }
 
+const FormulaProgram& FormulaAST::GetProgram() const noexcept {
+    return program_;
+}
+
 void FormulaAST::Print(std::ostream& out) const {
     root_expr_->Print(out);
 }
 
 void FormulaAST::PrintFormula(std::ostream& out) const {
     root_expr_->PrintFormula(out, ASTImpl::EP_ATOM);
-}
\ No newline at end of file
+}
+
+double ReadReferencedNumber(const CellInterface* cell) {
+    if (cell == nullptr) {
+        return 0.0;
+    }
+
+    if (const std::optional<double> number = cell->GetNumber()) {
+        return *number;
+    }
+
+    auto value = cell->GetValueView();
+
+    if (std::holds_alternative<FormulaError>(value)) {
+        throw FormulaError(FormulaError::Category::Value);
+    }
+    else if (std::holds_alternative<std::string_view>(value)) {
+        if (auto converted_value = ASTImpl::ConvertToNumber(std::get<std::string_view>(value))) {
+            return *converted_value;
+        }
+
+        throw FormulaError(FormulaError::Category::Value);
+    }
+
+    return std::get<double>(value);
+}
+
+void EvaluateBatch(const FormulaProgram::Code& code, const double* lhs, const double* rhs, std::size_t count,
+    double* results) noexcept {
+
+    assert(IsBatchable(code));
+
+    switch (code.steps[2].op) {
+    case FormulaProgram::Op::Add:
+        ASTImpl::EvaluateLanes<FormulaProgram::Op::Add>(lhs, rhs, count, results);
+        break;
+    case FormulaProgram::Op::Subtract:
+        ASTImpl::EvaluateLanes<FormulaProgram::Op::Subtract>(lhs, rhs, count, results);
+        break;
+    case FormulaProgram::Op::Multiply:
+        ASTImpl::EvaluateLanes<FormulaProgram::Op::Multiply>(lhs, rhs, count, results);
+        break;
+    default:
+        ASTImpl::EvaluateLanes<FormulaProgram::Op::Divide>(lhs, rhs, count, results);
+        break;
+    }
+}
+
+bool IsBatchable(const FormulaProgram::Code& code) noexcept {
+    const std::vector<FormulaProgram::Step>& steps = code.steps;
+
+    return steps.size() == 3 && ASTImpl::IsOperand(steps[0].op) && ASTImpl::IsOperand(steps[1].op)
+        && steps[2].op != FormulaProgram::Op::Negate && !ASTImpl::IsOperand(steps[2].op);
+}
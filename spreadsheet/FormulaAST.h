@@ -4,6 +4,7 @@
 #include <stdexcept>
 
 #include "common.h"
+#include "formula.h"
 #include "FormulaLexer.h"
 
 namespace ASTImpl {
@@ -16,21 +17,36 @@ class ParsingError final : public std::runtime_error {
 
 class FormulaAST final {
 public:
-    explicit FormulaAST(std::unique_ptr<ASTImpl::Expr> root_expr, std::forward_list<Position> cells);
-    FormulaAST(FormulaAST&&) noexcept = default;
-    FormulaAST& operator=(FormulaAST&&) noexcept = default;
+    // compiles the program unless given the code of the formula it is a copy of
+    explicit FormulaAST(std::unique_ptr<ASTImpl::Expr> root_expr, std::forward_list<CellReference> cells,
+        std::shared_ptr<const FormulaProgram::Code> code = nullptr);
+    FormulaAST(FormulaAST&&) noexcept;
+    FormulaAST& operator=(FormulaAST&&) noexcept;
     ~FormulaAST() noexcept;
 
+    // a deep copy with the references moved by the offset and unbound, the ones leaving the sheet become #REF!
+    FormulaAST Clone(int row_offset, int col_offset) const;
     double Execute(const SheetInterface& spreadsheet) const;
-    const std::forward_list<Position>& GetCells() const noexcept;
-    std::forward_list<Position>& GetCells() noexcept;
+    double Execute(const SheetInterface& spreadsheet, Profiler& profiler) const;
+    const std::forward_list<CellReference>& GetCells() const noexcept;
+    std::forward_list<CellReference>& GetCells() noexcept;
+    const FormulaProgram& GetProgram() const noexcept;
     void Print(std::ostream& out) const;
     void PrintFormula(std::ostream& out) const;
 
 private:
+    using Kernel = double (*)(const FormulaProgram& program, const SheetInterface& spreadsheet);
+
     std::unique_ptr<ASTImpl::Expr> root_expr_;
-    std::forward_list<Position> referenced_cells_;
+    std::forward_list<CellReference> referenced_cells_;
+    FormulaProgram program_;
+    // evaluates a formula of one of the most common shapes in place of the tree, nullptr for the others
+    Kernel kernel_ = nullptr;
 };
 
+// the number a formula reads from the referenced cell, a missing one reads as zero;
+// throws the FormulaError the evaluation would
+double ReadReferencedNumber(const CellInterface* cell);
+
 FormulaAST ParseFormulaAST(std::istream& in);
 FormulaAST ParseFormulaAST(const std::string& in_str);
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Runs a workload once and reports its wall time and throughput;
+// a workload returns the number of operations it has performed.
+class BenchRunner {
+public:
+    template <class BenchFunc>
+    void RunBench(BenchFunc func, const std::string& bench_name) {
+        const auto start = std::chrono::steady_clock::now();
+        const std::size_t operations = func();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << std::left << std::setw(40) << bench_name
+                  << std::right << std::setw(12) << std::fixed << std::setprecision(3)
+                  << elapsed.count() * 1000 << " ms"
+                  << std::setw(16) << std::setprecision(0)
+                  << (elapsed.count() > 0 ? operations / elapsed.count() : 0.0) << " ops/s" << std::endl;
+    }
+};
+
+#define RUN_BENCH(br, func, ...) br.RunBench([&] { return func(__VA_ARGS__); }, #func "/" #__VA_ARGS__)
@@ -0,0 +1,114 @@
+#include <random>
+
+#include "generators.h"
+
+namespace generators {
+    namespace {
+        std::string MakeReference(Position pos) {
+            char buffer[Position::MAX_POSITION_LENGTH];
+            return std::string(buffer, pos.ToChars(buffer));
+        }
+    } // unnamed namespace
+
+    std::vector<Position> GeneratePositions(Size size, double density, std::uint32_t seed) {
+        std::mt19937 generator(seed);
+        std::bernoulli_distribution filled(density);
+        std::vector<Position> positions;
+
+        for (int row = 0; row < size.rows; ++row) {
+            for (int col = 0; col < size.cols; ++col) {
+                if (filled(generator)) {
+                    positions.push_back({ row, col });
+                }
+            }
+        }
+
+        return positions;
+    }
+
+    std::vector<std::string> GenerateTexts(std::size_t count, std::size_t distinct_count,
+        double number_share, std::uint32_t seed) {
+
+        std::mt19937 generator(seed);
+        std::uniform_int_distribution<std::size_t> label(0, distinct_count - 1);
+        std::bernoulli_distribution is_number(number_share);
+        std::uniform_real_distribution<double> number(-1000.0, 1000.0);
+        std::vector<std::string> texts;
+        texts.reserve(count);
+
+        for (std::size_t i = 0; i < count; ++i) {
+            if (is_number(generator)) {
+                texts.push_back(std::to_string(number(generator)));
+            }
+            else {
+                texts.push_back("label_" + std::to_string(label(generator)));
+            }
+        }
+
+        return texts;
+    }
+
+    std::vector<std::string> GenerateFormulas(const std::vector<Position>& positions,
+        int references_per_formula, std::uint32_t seed) {
+
+        std::mt19937 generator(seed);
+        std::uniform_int_distribution<int> operation(0, 3);
+        std::uniform_real_distribution<double> constant(1.0, 10.0);
+        std::vector<std::string> formulas;
+        formulas.reserve(positions.size());
+
+        for (std::size_t i = 0; i < positions.size(); ++i) {
+            std::string formula = "=" + std::to_string(constant(generator));
+
+            for (int j = 0; j < references_per_formula && i > 0; ++j) {
+                std::uniform_int_distribution<std::size_t> preceding(0, i - 1);
+                formula += "+-*/"[operation(generator)];
+                formula += MakeReference(positions[preceding(generator)]);
+            }
+
+            formulas.push_back(std::move(formula));
+        }
+
+        return formulas;
+    }
+
+    void FillChain(SheetInterface& sheet, int length) {
+        sheet.SetCell({ 0, 0 }, "1");
+
+        for (int row = 1; row < length; ++row) {
+            sheet.SetCell({ row, 0 }, "=" + MakeReference({ row - 1, 0 }) + "+1");
+        }
+    }
+
+    void FillFanOut(SheetInterface& sheet, int width) {
+        sheet.SetCell({ 0, 0 }, "1");
+
+        for (int col = 0; col < width; ++col) {
+            sheet.SetCell({ 1, col }, "=A1*" + std::to_string(col + 1));
+        }
+    }
+
+    void FillMixed(SheetInterface& sheet, Size size, double density, double formula_share, std::uint32_t seed) {
+        const std::vector<Position> positions = GeneratePositions(size, density, seed);
+        const std::vector<std::string> texts = GenerateTexts(positions.size(), 64, 0.7, seed);
+
+        for (std::size_t i = 0; i < positions.size(); ++i) {
+            sheet.SetCell(positions[i], texts[i]);
+        }
+
+        std::mt19937 generator(seed);
+        std::bernoulli_distribution is_formula(formula_share);
+        std::vector<Position> formula_positions;
+
+        for (Position pos : positions) {
+            if (is_formula(generator)) {
+                formula_positions.push_back(pos);
+            }
+        }
+
+        const std::vector<std::string> formulas = GenerateFormulas(formula_positions, 2, seed);
+        for (std::size_t i = 0; i < formula_positions.size(); ++i) {
+            sheet.SetCell(formula_positions[i], formulas[i]);
+        }
+    }
+} // namespace generators
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../common.h"
+
+// Deterministic synthetic workloads: equal arguments always produce equal sheets.
+namespace generators {
+    inline constexpr std::uint32_t DEFAULT_SEED = 42;
+
+    // positions of a size.rows x size.cols block filled with the given density, in row-major order
+    std::vector<Position> GeneratePositions(Size size, double density, std::uint32_t seed = DEFAULT_SEED);
+
+    // labels drawn from distinct_count different values, numbers mixed in with the given share
+    std::vector<std::string> GenerateTexts(std::size_t count, std::size_t distinct_count,
+        double number_share, std::uint32_t seed = DEFAULT_SEED);
+
+    // formulas for the given positions, each referencing cells that precede it in row-major order,
+    // so the resulting sheet is always acyclic
+    std::vector<std::string> GenerateFormulas(const std::vector<Position>& positions,
+        int references_per_formula, std::uint32_t seed = DEFAULT_SEED);
+
+    // A1 is a number, every next row of column A adds one to the previous row
+    void FillChain(SheetInterface& sheet, int length);
+
+    // A1 is a number referenced by width formulas in row 2
+    void FillFanOut(SheetInterface& sheet, int width);
+
+    // fills the positions with numbers and texts, then overlays formulas with the given share
+    void FillMixed(SheetInterface& sheet, Size size, double density, double formula_share,
+        std::uint32_t seed = DEFAULT_SEED);
+} // namespace generators
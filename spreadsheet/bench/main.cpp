@@ -0,0 +1,577 @@
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common.h"
+#include "../formula.h"
+#include "../recalculation.h"
+#include "../sheet.h"
+#include "bench_runner.h"
+#include "generators.h"
+
+namespace {
+    std::size_t SetTextCells(int rows, int cols, double density) {
+        const auto positions = generators::GeneratePositions({ rows, cols }, density);
+        const auto texts = generators::GenerateTexts(positions.size(), 64, 0.5);
+
+        auto sheet = CreateSheet();
+        for (std::size_t i = 0; i < positions.size(); ++i) {
+            sheet->SetCell(positions[i], texts[i]);
+        }
+
+        return positions.size();
+    }
+
+    // writes a block of numbers, then sums every row with a formula reading them
+    std::size_t IngestNumbers(int rows, int cols, bool native) {
+        std::vector<double> values(static_cast<std::size_t>(rows) * cols);
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            values[i] = static_cast<double>(i) * 0.25;
+        }
+
+        auto sheet = CreateSheet();
+        if (native) {
+            static_cast<Sheet&>(*sheet).SetNumbers({ 0, 0 }, { rows, cols }, values.data());
+        }
+        else {
+            for (int row = 0; row < rows; ++row) {
+                for (int col = 0; col < cols; ++col) {
+                    sheet->SetCell({ row, col }, std::to_string(values[static_cast<std::size_t>(row) * cols + col]));
+                }
+            }
+        }
+
+        std::string sum = "=A1";
+        for (int col = 1; col < cols; ++col) {
+            sum += "+" + Position{ 0, col }.ToString();
+        }
+
+        sheet->SetCell({ 0, cols }, sum);
+        static_cast<Sheet&>(*sheet).FillDown({ 0, cols }, { rows, 1 });
+
+        for (int row = 0; row < rows; ++row) {
+            sheet->GetCell({ row, cols })->GetValue();
+        }
+
+        return values.size();
+    }
+
+    std::size_t SetFormulaCells(int rows, int cols, double density) {
+        const auto positions = generators::GeneratePositions({ rows, cols }, density);
+        const auto formulas = generators::GenerateFormulas(positions, 3);
+
+        auto sheet = CreateSheet();
+        for (std::size_t i = 0; i < positions.size(); ++i) {
+            sheet->SetCell(positions[i], formulas[i]);
+        }
+
+        return positions.size();
+    }
+
+    // probes every position of the block, hitting both occupied and empty cells
+    std::size_t ReadCells(int rows, int cols, double density) {
+        constexpr int PASSES = 10;
+
+        auto sheet = CreateSheet();
+        generators::FillMixed(*sheet, { rows, cols }, density, 0.0);
+
+        for (int pass = 0; pass < PASSES; ++pass) {
+            for (int row = 0; row < rows; ++row) {
+                for (int col = 0; col < cols; ++col) {
+                    sheet->GetCell({ row, col });
+                }
+            }
+        }
+
+        return static_cast<std::size_t>(rows) * cols * PASSES;
+    }
+
+    // pulls a block of numbers and formula results, cell by cell or through one bulk read
+    std::size_t ReadNumberBlock(int rows, int cols, bool bulk) {
+        constexpr int PASSES = 10;
+
+        std::vector<double> values(static_cast<std::size_t>(rows) * cols);
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            values[i] = static_cast<double>(i);
+        }
+
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        concrete_sheet.SetNumbers({ 0, 0 }, { rows, cols }, values.data());
+        sheet->SetCell({ 0, cols }, "=A1*2");
+        concrete_sheet.FillDown({ 0, cols }, { rows, 1 });
+
+        std::vector<ValueKind> kinds(static_cast<std::size_t>(rows) * (cols + 1));
+        values.resize(kinds.size());
+        double sum = 0.0;
+
+        for (int pass = 0; pass < PASSES; ++pass) {
+            if (bulk) {
+                concrete_sheet.ReadRange({ 0, 0 }, { rows, cols + 1 }, values.data(), kinds.data());
+                continue;
+            }
+
+            for (int row = 0; row < rows; ++row) {
+                for (int col = 0; col <= cols; ++col) {
+                    const CellInterface::Value value = sheet->GetCell({ row, col })->GetValue();
+
+                    if (const double* number = std::get_if<double>(&value)) {
+                        sum += *number;
+                    }
+                }
+            }
+        }
+
+        return kinds.size() * PASSES + (sum < 0.0 ? 1 : 0);
+    }
+
+    // a column of one formula filled down, recomputed after every rewrite of its inputs,
+    // read in bulk or cell by cell; a formula of one operation is evaluated in batches in bulk
+    std::size_t RecalcComputedColumn(int rows, int passes, bool bulk, const char* formula = "=(A1+B1)*A1/(B1+1)-A1*0.5") {
+        std::vector<double> inputs(static_cast<std::size_t>(rows) * 2);
+        std::vector<double> values(rows);
+
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        sheet->SetCell({ 0, 2 }, formula);
+        concrete_sheet.FillDown({ 0, 2 }, { rows, 1 });
+
+        double sum = 0.0;
+
+        for (int pass = 0; pass < passes; ++pass) {
+            for (std::size_t i = 0; i < inputs.size(); ++i) {
+                inputs[i] = static_cast<double>(i % 97 + pass);
+            }
+
+            concrete_sheet.SetNumbers({ 0, 0 }, { rows, 2 }, inputs.data());
+
+            if (bulk) {
+                concrete_sheet.ReadRange({ 0, 2 }, { rows, 1 }, values.data(), nullptr);
+                sum += values.back();
+                continue;
+            }
+
+            for (int row = 0; row < rows; ++row) {
+                const CellInterface::Value value = sheet->GetCell({ row, 2 })->GetValue();
+                sum += std::get<double>(value);
+            }
+        }
+
+        return static_cast<std::size_t>(rows) * passes + (sum < 0.0 ? 1 : 0);
+    }
+
+    // the column of RecalcComputedColumn recomputed in the background after every rewrite of its
+    // inputs, in slices of the budget; the returned count includes the slices, to show the overhead
+    std::size_t RecalcInSlices(int rows, int passes, int budget_us) {
+        std::vector<double> inputs(static_cast<std::size_t>(rows) * 2);
+
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        sheet->SetCell({ 0, 2 }, "=(A1+B1)*A1/(B1+1)-A1*0.5");
+        concrete_sheet.FillDown({ 0, 2 }, { rows, 1 });
+
+        std::size_t slices = 0;
+
+        for (int pass = 0; pass < passes; ++pass) {
+            for (std::size_t i = 0; i < inputs.size(); ++i) {
+                inputs[i] = static_cast<double>(i % 97 + pass);
+            }
+
+            concrete_sheet.SetNumbers({ 0, 0 }, { rows, 2 }, inputs.data());
+            Recalculation recalculation(concrete_sheet);
+
+            while (recalculation.Run(std::chrono::microseconds(budget_us)) == Recalculation::Status::Running) {
+                ++slices;
+            }
+        }
+
+        return static_cast<std::size_t>(rows) * passes + slices;
+    }
+
+    // the same rewrites with only a viewport of the column brought up to date before the next
+    // one, which supersedes the rest; the latency a user waits for after an edit
+    std::size_t RecalcViewport(int rows, int passes, int visible_rows) {
+        std::vector<double> inputs(static_cast<std::size_t>(rows) * 2);
+
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        sheet->SetCell({ 0, 2 }, "=(A1+B1)*A1/(B1+1)-A1*0.5");
+        concrete_sheet.FillDown({ 0, 2 }, { rows, 1 });
+        concrete_sheet.AddViewport({ rows / 2, 0 }, { visible_rows, 3 });
+
+        for (int pass = 0; pass < passes; ++pass) {
+            for (std::size_t i = 0; i < inputs.size(); ++i) {
+                inputs[i] = static_cast<double>(i % 97 + pass);
+            }
+
+            concrete_sheet.SetNumbers({ 0, 0 }, { rows, 2 }, inputs.data());
+            Recalculation(concrete_sheet).RunVisible();
+        }
+
+        return static_cast<std::size_t>(visible_rows) * passes;
+    }
+
+    std::size_t ParseFormulas(int count) {
+        const auto positions = generators::GeneratePositions({ count / 10, 10 }, 1.0);
+        const auto formulas = generators::GenerateFormulas(positions, 4);
+
+        for (const std::string& formula : formulas) {
+            ParseFormula(formula.substr(1));
+        }
+
+        return formulas.size();
+    }
+
+    // every edit of the chain head dirties the whole chain, reading the tail recomputes it
+    std::size_t RecalcDeepChain(int length, int edits) {
+        auto sheet = CreateSheet();
+        generators::FillChain(*sheet, length);
+
+        for (int i = 0; i < edits; ++i) {
+            sheet->SetCell({ 0, 0 }, std::to_string(i));
+            sheet->GetCell({ length - 1, 0 })->GetValue();
+        }
+
+        return static_cast<std::size_t>(length) * edits;
+    }
+
+    std::size_t RecalcWideFanOut(int width, int edits) {
+        auto sheet = CreateSheet();
+        generators::FillFanOut(*sheet, width);
+
+        for (int i = 0; i < edits; ++i) {
+            sheet->SetCell({ 0, 0 }, std::to_string(i));
+
+            for (int col = 0; col < width; ++col) {
+                sheet->GetCell({ 1, col })->GetValue();
+            }
+        }
+
+        return static_cast<std::size_t>(width) * edits;
+    }
+
+    // a burst of edits to shared inputs without reads in between
+    // the input only feeds the fan-out through a formula masking it, so reads after an edit
+    // evaluate that one formula and find every other dependent current
+    std::size_t RecalcMaskedFanOut(int width, int edits) {
+        auto sheet = CreateSheet();
+        sheet->SetCell({ 0, 0 }, "1");
+        sheet->SetCell({ 1, 0 }, "=A1*0");
+
+        for (int col = 0; col < width; ++col) {
+            sheet->SetCell({ 2, col }, "=A2+" + std::to_string(col));
+            sheet->SetCell({ 3, col }, "=" + Position{ 2, col }.ToString() + "*2");
+        }
+
+        for (int i = 0; i < edits; ++i) {
+            sheet->SetCell({ 0, 0 }, std::to_string(i));
+
+            for (int col = 0; col < width; ++col) {
+                sheet->GetCell({ 3, col })->GetValue();
+            }
+        }
+
+        return static_cast<std::size_t>(width) * edits;
+    }
+
+    std::size_t InvalidationStorm(int inputs, int dependents_per_input, int edits) {
+        auto sheet = CreateSheet();
+
+        for (int col = 0; col < inputs; ++col) {
+            sheet->SetCell({ 0, col }, "1");
+
+            for (int row = 1; row <= dependents_per_input; ++row) {
+                sheet->SetCell({ row, col }, "=" + Position{ 0, col }.ToString() + "+" + Position{ row - 1, col }.ToString());
+            }
+        }
+
+        for (int i = 0; i < edits; ++i) {
+            sheet->SetCell({ 0, i % inputs }, std::to_string(i));
+        }
+
+        return static_cast<std::size_t>(edits);
+    }
+
+    // formulas over not yet written inputs, then the inputs, then everything cleared again
+    std::size_t ChurnCells(int rows, int rounds) {
+        auto sheet = CreateSheet();
+
+        for (int round = 0; round < rounds; ++round) {
+            for (int row = 0; row < rows; ++row) {
+                sheet->SetCell({ row, 0 }, "=B" + std::to_string(row + 1) + "+C" + std::to_string(row + 1));
+                sheet->SetCell({ row, 1 }, std::to_string(round));
+            }
+
+            for (int row = 0; row < rows; ++row) {
+                sheet->ClearCell({ row, 1 });
+                sheet->ClearCell({ row, 0 });
+            }
+        }
+
+        return static_cast<std::size_t>(rows) * rounds * 4;
+    }
+
+    // every accepted formula on the chain head walks all of its dependents looking for a cycle
+    std::size_t CycleCheckLargeGraph(int size, int checks) {
+        auto sheet = CreateSheet();
+        generators::FillChain(*sheet, size);
+
+        for (int i = 0; i < checks; ++i) {
+            sheet->SetCell({ 0, 0 }, "=B" + std::to_string(i % 2 + 1));
+        }
+
+        return static_cast<std::size_t>(size) * checks;
+    }
+
+    std::size_t PrintSheet(int rows, int cols, double density) {
+        auto sheet = CreateSheet();
+        generators::FillMixed(*sheet, { rows, cols }, density, 0.2);
+
+        std::ostringstream texts;
+        sheet->PrintTexts(texts);
+        std::ostringstream values;
+        sheet->PrintValues(values);
+
+        return static_cast<std::size_t>(rows) * cols * 2;
+    }
+
+    // inserts and deletes rows at the given fraction of the sheet height, only the rows
+    // below and the formulas referencing them are touched
+    std::size_t ShiftRows(int rows, int cols, double at, int rounds) {
+        auto sheet = CreateSheet();
+        generators::FillMixed(*sheet, { rows, cols }, 0.5, 0.3);
+
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        const int first = static_cast<int>(rows * at);
+
+        for (int round = 0; round < rounds; ++round) {
+            concrete_sheet.InsertRows(first, 2);
+            concrete_sheet.DeleteRows(first, 2);
+        }
+
+        return static_cast<std::size_t>(rounds) * 2;
+    }
+
+    std::size_t ShiftCols(int rows, int cols, int rounds) {
+        auto sheet = CreateSheet();
+        generators::FillMixed(*sheet, { rows, cols }, 0.5, 0.3);
+
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+
+        for (int round = 0; round < rounds; ++round) {
+            concrete_sheet.InsertCols(cols / 2);
+            concrete_sheet.DeleteCols(cols / 2);
+        }
+
+        return static_cast<std::size_t>(rounds) * 2;
+    }
+
+    // the running total of a column, written one formula at a time
+    std::size_t SetFormulaColumn(int rows) {
+        auto sheet = CreateSheet();
+        sheet->SetCell({ 0, 0 }, "1");
+        sheet->SetCell({ 0, 1 }, "=A1");
+
+        for (int row = 1; row < rows; ++row) {
+            const std::string row_name = std::to_string(row);
+            sheet->SetCell({ row, 0 }, "=A" + row_name + "+1");
+            sheet->SetCell({ row, 1 }, "=B" + row_name + "+A" + std::to_string(row + 1));
+        }
+
+        return static_cast<std::size_t>(rows) * 2;
+    }
+
+    // the same column filled down from its parsed second row
+    std::size_t FillDownFormulaColumn(int rows) {
+        auto sheet = CreateSheet();
+        sheet->SetCell({ 0, 0 }, "1");
+        sheet->SetCell({ 0, 1 }, "=A1");
+        sheet->SetCell({ 1, 0 }, "=A1+1");
+        sheet->SetCell({ 1, 1 }, "=B1+A2");
+
+        static_cast<Sheet&>(*sheet).FillDown({ 1, 0 }, { rows - 1, 2 });
+
+        return static_cast<std::size_t>(rows) * 2;
+    }
+
+    // steps back and forth through a history of formula edits without reparsing them
+    std::size_t UndoRedoEdits(int edits, int rounds) {
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        concrete_sheet.SetUndoLimit(edits);
+        generators::FillChain(*sheet, edits);
+
+        for (int row = 1; row < edits; ++row) {
+            sheet->SetCell({ row, 1 }, "=A" + std::to_string(row) + "*2+B" + std::to_string(row));
+        }
+
+        for (int round = 0; round < rounds; ++round) {
+            while (concrete_sheet.Undo()) {
+            }
+            while (concrete_sheet.Redo()) {
+            }
+        }
+
+        return static_cast<std::size_t>(edits) * rounds * 2;
+    }
+
+    // edits of the fan-out input with a subscriber, which reads every dependent reported pending
+    std::size_t NotifyWideFanOut(int width, int edits) {
+        auto sheet = CreateSheet();
+        generators::FillFanOut(*sheet, width);
+
+        // the subscriber shows every dependent from the start
+        for (int col = 0; col < width; ++col) {
+            sheet->GetCell({ 1, col })->GetValueView();
+        }
+
+        std::size_t notified = 0;
+        static_cast<Sheet&>(*sheet).Subscribe([&](const ChangeTracker::Changes& changes) {
+            notified += changes.changed.size();
+
+            for (Position pos : changes.pending) {
+                sheet->GetCell(pos)->GetValueView();
+                ++notified;
+            }
+        });
+
+        for (int i = 0; i < edits; ++i) {
+            sheet->SetCell({ 0, 0 }, std::to_string(i));
+        }
+
+        return notified;
+    }
+
+    enum class Durability {
+        Off,
+        GroupCommit,
+        SyncEachEdit,
+    };
+
+    // sets numbers and texts over a block, the logged runs ending with every edit durable
+    std::size_t LoggedEdits(int edits, Durability durability) {
+        const std::filesystem::path directory = std::filesystem::temp_directory_path()
+            / ("spreadsheet-bench-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        if (durability != Durability::Off) {
+            std::filesystem::create_directories(directory);
+            concrete_sheet.OpenLog(directory.string());
+        }
+
+        for (int i = 0; i < edits; ++i) {
+            const Position pos = { i % 1000, i / 1000 % 10 };
+
+            if (i % 2 == 0) {
+                concrete_sheet.SetNumber(pos, i);
+            }
+            else {
+                sheet->SetCell(pos, "text " + std::to_string(i));
+            }
+
+            if (durability == Durability::SyncEachEdit) {
+                concrete_sheet.SyncLog();
+            }
+        }
+
+        if (durability != Durability::Off) {
+            concrete_sheet.SyncLog();
+            sheet.reset();
+            std::filesystem::remove_all(directory);
+        }
+
+        return static_cast<std::size_t>(edits);
+    }
+
+    // every round rewrites the chain head and lets all the readers race over the dirty formulas
+    std::size_t ConcurrentReads(int thread_count) {
+        constexpr int CHAIN_LENGTH = 1000;
+        constexpr int ROUNDS = 20;
+
+        auto sheet = CreateSheet();
+        generators::FillChain(*sheet, CHAIN_LENGTH);
+        std::atomic<std::size_t> reads = 0;
+
+        for (int round = 0; round < ROUNDS; ++round) {
+            sheet->SetCell({ 0, 0 }, std::to_string(round));
+
+            std::vector<std::thread> readers;
+            for (int i = 0; i < thread_count; ++i) {
+                readers.emplace_back([&sheet, &reads, i, thread_count] {
+                    std::size_t local_reads = 0;
+                    const int offset = CHAIN_LENGTH * i / thread_count;
+
+                    for (int pass = 0; pass < 10; ++pass) {
+                        for (int j = 0; j < CHAIN_LENGTH; ++j) {
+                            const int row = CHAIN_LENGTH - 1 - (offset + j) % CHAIN_LENGTH;
+                            sheet->GetCell({ row, 0 })->GetValue();
+                            ++local_reads;
+                        }
+                    }
+
+                    reads += local_reads;
+                });
+            }
+
+            for (std::thread& reader : readers) {
+                reader.join();
+            }
+        }
+
+        return reads;
+    }
+} // unnamed namespace
+
+int main() {
+    BenchRunner br;
+    RUN_BENCH(br, SetTextCells, 1000, 100, 0.01);
+    RUN_BENCH(br, SetTextCells, 1000, 100, 0.5);
+    RUN_BENCH(br, ReadCells, 2000, 100, 0.001);
+    RUN_BENCH(br, ReadCells, 2000, 100, 0.05);
+    RUN_BENCH(br, ReadCells, 2000, 100, 0.9);
+    RUN_BENCH(br, IngestNumbers, 10000, 20, false);
+    RUN_BENCH(br, IngestNumbers, 10000, 20, true);
+    RUN_BENCH(br, ReadNumberBlock, 5000, 20, false);
+    RUN_BENCH(br, ReadNumberBlock, 5000, 20, true);
+    RUN_BENCH(br, SetFormulaCells, 1000, 20, 0.05);
+    RUN_BENCH(br, SetFormulaCells, 500, 20, 0.5);
+    RUN_BENCH(br, ParseFormulas, 20000);
+    RUN_BENCH(br, RecalcDeepChain, 2000, 50);
+    RUN_BENCH(br, RecalcWideFanOut, 10000, 50);
+    RUN_BENCH(br, RecalcMaskedFanOut, 10000, 50);
+    RUN_BENCH(br, RecalcComputedColumn, 16000, 20, false);
+    RUN_BENCH(br, RecalcComputedColumn, 16000, 20, true);
+    RUN_BENCH(br, RecalcComputedColumn, 16000, 20, false, "=A1*B1");
+    RUN_BENCH(br, RecalcComputedColumn, 16000, 20, true, "=A1*B1");
+    RUN_BENCH(br, RecalcInSlices, 16000, 20, 100);
+    RUN_BENCH(br, RecalcInSlices, 16000, 20, 10000);
+    RUN_BENCH(br, RecalcViewport, 16000, 20, 50);
+    RUN_BENCH(br, InvalidationStorm, 10, 200, 2000);
+    RUN_BENCH(br, ChurnCells, 5000, 20);
+    RUN_BENCH(br, CycleCheckLargeGraph, 5000, 100);
+    RUN_BENCH(br, PrintSheet, 1000, 50, 0.05);
+    RUN_BENCH(br, PrintSheet, 1000, 50, 0.8);
+    RUN_BENCH(br, ShiftRows, 2000, 20, 0.0, 50);
+    RUN_BENCH(br, ShiftRows, 2000, 20, 0.99, 500);
+    RUN_BENCH(br, ShiftCols, 2000, 40, 50);
+    RUN_BENCH(br, SetFormulaColumn, 16000);
+    RUN_BENCH(br, FillDownFormulaColumn, 16000);
+    RUN_BENCH(br, UndoRedoEdits, 5000, 10);
+    RUN_BENCH(br, NotifyWideFanOut, 10000, 50);
+    RUN_BENCH(br, LoggedEdits, 100000, Durability::Off);
+#if !defined(_WIN32)
+    RUN_BENCH(br, LoggedEdits, 100000, Durability::GroupCommit);
+    RUN_BENCH(br, LoggedEdits, 2000, Durability::SyncEachEdit);
+#endif
+    RUN_BENCH(br, ConcurrentReads, 1);
+    RUN_BENCH(br, ConcurrentReads, 2);
+    RUN_BENCH(br, ConcurrentReads, 4);
+    RUN_BENCH(br, ConcurrentReads, 8);
+    RUN_BENCH(br, ConcurrentReads, 16);
+    RUN_BENCH(br, ConcurrentReads, 32);
+}
@@ -3,15 +3,138 @@
 
 #include "cell.h"
 
-Cell::Cell(Sheet& spreadsheet)
+const FormulaInterface::Value& detail::FormulaImpl::GetCachedValue() const {
+    CacheState state = cache_state_.load(std::memory_order_acquire);
+
+    while (state != CacheState::Done) {
+        if ((state == CacheState::Dirty || state == CacheState::Stale || state == CacheState::Evicted)
+            && cache_state_.compare_exchange_strong(state, CacheState::Computing, std::memory_order_acquire)) {
+
+            try {
+                if (state == CacheState::Stale && !InputsChanged()) {
+                    profiler_.CountEarlyCutoff();
+                }
+                else {
+                    profiler_.CountCacheMiss();
+                    FormulaInterface::Value value;
+                    {
+                        Profiler::Timer timer(profiler_, Profiler::Event::Evaluate, text_);
+                        value = formula_->Evaluate(spreadsheet_, profiler_);
+                    }
+
+                    Store(value);
+                }
+            }
+            catch (...) {
+                cache_state_.store(CacheState::Dirty, std::memory_order_release);
+                throw;
+            }
+
+            verified_at_ = spreadsheet_.GetRevision();
+            cache_state_.store(CacheState::Done, std::memory_order_release);
+            return cache_;
+        }
+
+        if (state == CacheState::Computing) {
+            std::this_thread::yield();
+        }
+
+        state = cache_state_.load(std::memory_order_acquire);
+    }
+
+    profiler_.CountCacheHit();
+    return cache_;
+}
+
+bool detail::FormulaImpl::InputsChanged() const {
+    for (const CellReference& reference : formula_->GetReferences()) {
+        // every valid reference of a formula sitting in a cell is bound
+        const auto* cell = static_cast<const Cell*>(reference.cell);
+
+        if (cell == nullptr) {
+            continue;
+        }
+
+        // the value is not needed, only the evaluation of a stale input
+        cell->GetValueView();
+
+        if (cell->GetChangedAt() > verified_at_) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void detail::FormulaImpl::Publish(const FormulaInterface::Value& value) const noexcept {
+    profiler_.CountCacheMiss();
+    profiler_.CountBatchedEvaluation();
+    Store(value);
+    verified_at_ = spreadsheet_.GetRevision();
+    cache_state_.store(CacheState::Done, std::memory_order_release);
+}
+
+void detail::FormulaImpl::Store(const FormulaInterface::Value& value) const {
+    if (!(value == cache_)) {
+        cache_ = value;
+        changed_at_ = spreadsheet_.GetRevision();
+    }
+}
+
+Cell::Cell(Sheet& spreadsheet, Position pos)
     : impl_(nullptr)
-    , spreadsheet_(spreadsheet) {
+    , spreadsheet_(spreadsheet)
+    , pos_(pos) {
+}
+
+Cell::~Cell() noexcept {
+    spreadsheet_.GetValueCache().Forget(*this);
+}
+
+std::unique_ptr<detail::Impl> Cell::Clear() {
+    std::unique_ptr<detail::Impl> previous_impl = MakePlaceholder();
+    // read before the new references stamp placeholders of their own
+    const bool changed = impl_->GetChangedAt() == spreadsheet_.GetRevision();
+    AdjustCellsDependency(impl_.get());
+    spreadsheet_.GetProfiler().CountInvalidation(InvalidateUpperLevel(changed));
+
+    return previous_impl;
 }
 
-Cell::~Cell() noexcept = default;
+std::unique_ptr<detail::Impl> Cell::CloneContents(int row_offset, int col_offset) const {
+    if (is_placeholder_) {
+        return nullptr;
+    }
+
+    return impl_->Clone(row_offset, col_offset);
+}
+
+std::vector<Cell*> Cell::Detach() {
+    for (Cell* upper_cell : upper_level_) {
+        upper_cell->lower_level_.erase(this);
+    }
+
+    for (Cell* lower_cell : lower_level_) {
+        lower_cell->upper_level_.erase(this);
+    }
+
+    std::vector<Cell*> detached_lower_level(lower_level_.begin(), lower_level_.end());
+    upper_level_.clear();
+    lower_level_.clear();
+
+    return detached_lower_level;
+}
+
+std::uint64_t Cell::GetChangedAt() const noexcept {
+    return impl_->GetChangedAt();
+}
 
-void Cell::Clear() noexcept {
-    impl_ = std::make_unique<detail::EmptyImpl>("");
+const detail::FormulaImpl* Cell::GetFormula() const noexcept {
+    return impl_->AsFormula();
+}
+
+Position Cell::GetPosition() const noexcept {
+    return pos_;
 }
 
 std::vector<Position> Cell::GetReferencedCells() const {
@@ -22,64 +145,198 @@ std::string Cell::GetText() const noexcept {
     return impl_->GetText();
 }
 
+std::string_view Cell::GetTextView() const noexcept {
+    return impl_->GetTextView();
+}
+
+std::optional<double> Cell::GetNumber() const noexcept {
+    return impl_->GetNumber();
+}
+
+const std::unordered_set<Cell*>& Cell::GetUpperLevel() const noexcept {
+    return upper_level_;
+}
+
 Cell::Value Cell::GetValue() const {
-    return impl_->GetValue();
+    Value value = impl_->GetValue();
+    spreadsheet_.GetValueCache().Touch(*this);
+
+    return value;
+}
+
+Cell::ValueView Cell::GetValueView() const {
+    const ValueView value = impl_->GetValueView();
+    spreadsheet_.GetValueCache().Touch(*this);
+
+    return value;
 }
 
 bool Cell::HasUpperLevel() const {
     return !upper_level_.empty();
 }
 
-void Cell::Set(std::string text) {
-    bool update_statement = true;
+std::size_t Cell::InvalidateDependents(const std::vector<Cell*>& cells) {
+    // the cells themselves got new contents, so only the rest of their dependents need a walk
+    std::unordered_set<Cell*> invalidated(cells.begin(), cells.end());
+    std::vector<Cell*> to_invalidate;
+    std::size_t marked = 0;
 
-    if ((text.size() == 1 && (text.front() == ESCAPE_SIGN || text.front() == FORMULA_SIGN)) || text.empty()) {
-        impl_ = std::make_unique< detail::EmptyImpl>(std::move(text));
+    for (const Cell* cell : cells) {
+        to_invalidate.insert(to_invalidate.end(), cell->upper_level_.begin(), cell->upper_level_.end());
     }
-    else if (text.front() == FORMULA_SIGN) {
-        std::unique_ptr<detail::Impl> being_considered_impl = std::make_unique<detail::FormulaImpl>(std::move(text), spreadsheet_);
 
-        if (this->impl_ != nullptr && (impl_->GetText() == being_considered_impl->GetText())) {
-            update_statement = false;
+    while (!to_invalidate.empty()) {
+        Cell* cell = to_invalidate.back();
+        to_invalidate.pop_back();
+
+        if (!invalidated.insert(cell).second) {
+            continue;
         }
 
-        if (update_statement) {
-            if (!being_considered_impl->GetReferencedCells().empty() 
-                && CheckOnCyclicDependency(being_considered_impl.get())) {
+        cell->spreadsheet_.GetChangeTracker().Track(cell->pos_, cell);
 
-                throw CircularDependencyException("Cyclic dependency was met.");
-            }
+        if (!static_cast<detail::FormulaImpl*>(cell->impl_.get())->MarkStale()) {
+            continue;
+        }
 
-            impl_ = std::move(being_considered_impl);
+        ++marked;
+        to_invalidate.insert(to_invalidate.end(), cell->upper_level_.begin(), cell->upper_level_.end());
+    }
+
+    return marked;
+}
+
+bool Cell::IsPlaceholder() const noexcept {
+    return is_placeholder_;
+}
+
+std::unique_ptr<detail::Impl> Cell::MakePlaceholder() {
+    std::unique_ptr<detail::Impl> previous_impl = std::exchange(impl_, std::make_unique<detail::EmptyImpl>(""));
+    is_placeholder_ = true;
+    Stamp(previous_impl.get());
+
+    return previous_impl;
+}
+
+std::optional<Cell::Value> Cell::PeekValue() const {
+    return impl_->PeekValue();
+}
+
+std::unique_ptr<detail::Impl> Cell::Parse(Sheet& spreadsheet, std::string text) {
+    if ((text.size() == 1 && (text.front() == ESCAPE_SIGN || text.front() == FORMULA_SIGN)) || text.empty()) {
+        return std::make_unique<detail::EmptyImpl>(std::move(text));
+    }
+
+    if (text.front() == FORMULA_SIGN) {
+        Profiler::Timer timer(spreadsheet.GetProfiler(), Profiler::Event::Parse, text);
+        return std::make_unique<detail::FormulaImpl>(text, spreadsheet, spreadsheet.GetProfiler());
+    }
+
+    return std::make_unique<detail::TextImpl>(spreadsheet.GetTextPool().Intern(text));
+}
+
+std::unique_ptr<detail::Impl> Cell::Set(std::string text) {
+    std::unique_ptr<detail::Impl> being_considered_impl = Parse(spreadsheet_, std::move(text));
+
+    if (being_considered_impl->AsFormula() != nullptr) {
+        if (this->impl_ != nullptr && (impl_->GetTextView() == being_considered_impl->GetTextView())) {
+            return nullptr;
+        }
+
+        if (!being_considered_impl->GetReferencedCells().empty() 
+            && CheckOnCyclicDependency(being_considered_impl.get())) {
+
+            throw CircularDependencyException("Cyclic dependency was met.");
         }
     }
+
+    std::unique_ptr<detail::Impl> previous_impl = std::exchange(impl_, std::move(being_considered_impl));
+    is_placeholder_ = false;
+    const bool changed = Stamp(previous_impl.get());
+    AdjustCellsDependency(impl_.get());
+    spreadsheet_.GetProfiler().CountInvalidation(InvalidateUpperLevel(changed));
+
+    return previous_impl;
+}
+
+std::unique_ptr<detail::Impl> Cell::SetNumber(double number) {
+    std::unique_ptr<detail::Impl> previous_impl = std::exchange(impl_, std::make_unique<detail::NumberImpl>(number));
+    is_placeholder_ = false;
+
+    const bool changed = Stamp(previous_impl.get());
+    AdjustCellsDependency(impl_.get());
+    spreadsheet_.GetProfiler().CountInvalidation(InvalidateUpperLevel(changed));
+
+    return previous_impl;
+}
+
+std::unique_ptr<detail::Impl> Cell::SetContents(std::unique_ptr<detail::Impl> impl) {
+    std::unique_ptr<detail::Impl> previous_impl;
+
+    if (impl == nullptr) {
+        previous_impl = MakePlaceholder();
+    }
     else {
-        impl_ = std::make_unique<detail::TextImpl>(std::move(text));
+        previous_impl = std::exchange(impl_, std::move(impl));
+        is_placeholder_ = false;
+        // restored contents may keep a value computed from older inputs
+        impl_->InvalidateCache();
+        Stamp(previous_impl.get());
     }
 
-    if (update_statement) {
-        AdjustCellsDependency(impl_.get());
-        InvalidateCache(upper_level_);
-    }
+    AdjustCellsDependency(impl_.get());
+    return previous_impl;
 }
 
-void Cell::AdjustCellsDependency(const detail::Impl* const being_considered_impl) {
-    for (Cell* lower_cell : lower_level_) {
-        lower_cell->upper_level_.erase(this);
+void Cell::SetPosition(Position pos) noexcept {
+    pos_ = pos;
+}
+
+void Cell::ShiftReferences(const PositionShift& shift) {
+    auto* formula_impl = static_cast<detail::FormulaImpl*>(impl_.get());
+
+    // moved references keep their values, only the deleted ones turn into #REF!
+    if (formula_impl->ShiftReferences(shift)) {
+        spreadsheet_.GetChangeTracker().Track(pos_, this);
+        formula_impl->InvalidateCache();
+        spreadsheet_.GetProfiler().CountInvalidation(1 + InvalidateCache(upper_level_));
     }
+}
+
+void Cell::AdjustCellsDependency(detail::Impl* being_considered_impl) {
+    std::unordered_set<Cell*> previous_lower_level = std::move(lower_level_);
     lower_level_.clear();
 
-    for (const Position& cell_position : being_considered_impl->GetReferencedCells()) {
-        CellInterface* taken_cell = spreadsheet_.GetCell(cell_position);
+    // the new references are linked first, so placeholders kept by both versions survive
+    if (std::forward_list<CellReference>* references = being_considered_impl->GetReferences()) {
+        for (CellReference& reference : *references) {
+            if (!reference.pos.IsValid()) {
+                continue;
+            }
+
+            Cell* taken_cell = static_cast<Cell*>(spreadsheet_.GetCell(reference.pos));
+
+            if (taken_cell == nullptr) {
+                taken_cell = &spreadsheet_.CreatePlaceholder(reference.pos);
+            }
+
+            taken_cell->upper_level_.emplace(this);
+            lower_level_.emplace(taken_cell);
+            // cells never move in memory and stay while referenced, so the handle outlives the reference
+            reference.cell = taken_cell;
+        }
+    }
 
-        if (taken_cell == nullptr) {
-            spreadsheet_.SetCell(cell_position, "");
-            taken_cell = spreadsheet_.GetCell(cell_position);
+    for (Cell* lower_cell : previous_lower_level) {
+        if (lower_level_.count(lower_cell)) {
+            continue;
         }
 
-        Cell* casted_cell = static_cast<Cell*>(taken_cell);
-        casted_cell->upper_level_.emplace(this);
-        lower_level_.emplace(casted_cell);
+        lower_cell->upper_level_.erase(this);
+
+        if (lower_cell->IsPlaceholder() && !lower_cell->HasUpperLevel()) {
+            spreadsheet_.ReleasePlaceholder(lower_cell->GetPosition());
+        }
     }
 }
 
@@ -98,11 +355,14 @@ bool Cell::CheckOnCyclicDependency(const detail::Impl* const being_considered_im
 
     std::unordered_set<const CellInterface*> encountered;
     std::deque<const CellInterface*> to_check = { this };
+    std::size_t visited = 0;
 
     while (!to_check.empty()) {
         const CellInterface* const taken_cell = to_check.front();
+        ++visited;
 
         if (impl_cells.count(taken_cell)) {
+            spreadsheet_.GetProfiler().CountCycleCheck(visited);
             return true;
         }
         to_check.pop_front();
@@ -115,13 +375,47 @@ bool Cell::CheckOnCyclicDependency(const detail::Impl* const being_considered_im
         }
     }
 
+    spreadsheet_.GetProfiler().CountCycleCheck(visited);
     return false;
 }
 
-void Cell::InvalidateCache(const std::unordered_set<Cell*>& to_invalidate) {
+std::size_t Cell::InvalidateCache(const std::unordered_set<Cell*>& to_invalidate) {
+    std::size_t invalidated = 0;
+
     for (Cell* cell : to_invalidate) {
-        static_cast<detail::FormulaImpl*>(cell->impl_.get())->InvalidateCache();
+        spreadsheet_.GetChangeTracker().Track(cell->pos_, cell);
+
+        if (static_cast<detail::FormulaImpl*>(cell->impl_.get())->MarkStale()) {
+            invalidated += 1 + InvalidateCache(cell->upper_level_);
+        }
+    }
+
+    return invalidated;
+}
+
+std::size_t Cell::InvalidateUpperLevel(bool changed) {
+    if (!changed && impl_->PeekValue().has_value()) {
+        return 0;
+    }
+
+    std::size_t invalidated = 0;
 
-        InvalidateCache(cell->upper_level_);
+    for (Cell* cell : upper_level_) {
+        spreadsheet_.GetChangeTracker().Track(cell->pos_, cell);
+        auto* formula_impl = static_cast<detail::FormulaImpl*>(cell->impl_.get());
+
+        // a direct dependent of a changed value is certainly out of date
+        if (changed ? formula_impl->MarkDirty() : formula_impl->MarkStale()) {
+            invalidated += 1 + InvalidateCache(cell->upper_level_);
+        }
     }
+
+    return invalidated;
+}
+
+bool Cell::Stamp(const detail::Impl* previous_impl) {
+    const std::uint64_t revision = spreadsheet_.NextRevision();
+    impl_->Stamp(previous_impl, revision);
+
+    return impl_->GetChangedAt() == revision;
 }
\ No newline at end of file
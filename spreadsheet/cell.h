@@ -1,22 +1,86 @@
 #pragma once
 
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <forward_list>
+#include <mutex>
 #include <optional>
+#include <thread>
 #include <unordered_set>
 
 #include "common.h"
 #include "formula.h"
+#include "profiler.h"
 #include "sheet.h"
+#include "string_pool.h"
+
+class Sheet;
 
 namespace detail {
+    class FormulaImpl;
+
     class Impl {
     public:
         using Value = std::variant<std::string, double, FormulaError>;
+        using ValueView = std::variant<std::string_view, double, FormulaError>;
 
         virtual ~Impl() noexcept = default;
 
+        // nullptr for contents other than a formula
+        virtual const FormulaImpl* AsFormula() const noexcept {
+            return nullptr;
+        }
+
+        // the contents pasted at the given offset
+        virtual std::unique_ptr<Impl> Clone(int row_offset, int col_offset) const = 0;
+
+        // the sheet revision at which the value last changed
+        std::uint64_t GetChangedAt() const noexcept {
+            return changed_at_;
+        }
+
+        virtual std::optional<double> GetNumber() const noexcept {
+            return std::nullopt;
+        }
+
         virtual std::vector<Position> GetReferencedCells() const = 0;
+        // the reference slots to bind, nullptr for contents other than a formula
+        virtual std::forward_list<CellReference>* GetReferences() noexcept {
+            return nullptr;
+        }
+
         virtual std::string GetText() const noexcept = 0;
+        virtual std::string_view GetTextView() const noexcept = 0;
         virtual Value GetValue() const = 0;
+        virtual ValueView GetValueView() const = 0;
+        // must not overlap with reads of the cell
+        virtual void InvalidateCache() noexcept {
+        }
+
+        // the value if it is known without evaluating anything
+        virtual std::optional<Value> PeekValue() const {
+            return GetValue();
+        }
+
+        // dates the contents replacing the previous ones at the revision; a value equal
+        // to the previous one keeps its date, so the dependents need no recalculation
+        virtual void Stamp(const Impl* previous, std::uint64_t revision) {
+            changed_at_ = revision;
+
+            if (previous == nullptr) {
+                return;
+            }
+
+            if (std::optional<Value> previous_value = previous->PeekValue(); previous_value && *previous_value == GetValue()) {
+                changed_at_ = previous->changed_at_;
+            }
+        }
+
+    protected:
+        // formulas move it forward when evaluated
+        mutable std::uint64_t changed_at_ = 0;
     };
 
     class EmptyImpl final : public Impl {
@@ -25,6 +89,10 @@ namespace detail {
             : text_(text) {
         }
 
+        std::unique_ptr<Impl> Clone(int /* row_offset */, int /* col_offset */) const override {
+            return std::make_unique<EmptyImpl>(text_);
+        }
+
         std::vector<Position> GetReferencedCells() const override {
             return {};
         }
@@ -33,6 +101,10 @@ namespace detail {
             return text_;
         }
 
+        std::string_view GetTextView() const noexcept override {
+            return text_;
+        }
+
         Value GetValue() const override {
             if (text_.length() == 0) {
                 return 0.0;
@@ -44,14 +116,29 @@ namespace detail {
             return text_;
         }
 
+        ValueView GetValueView() const override {
+            if (text_.length() == 0) {
+                return 0.0;
+            }
+            else if (text_.front() == ESCAPE_SIGN) {
+                return std::string_view{};
+            }
+
+            return std::string_view(text_);
+        }
+
     private:
         std::string text_;
     };
 
     class TextImpl final : public Impl {
     public:
-        TextImpl(std::string text)
-            : text_(text) {
+        TextImpl(StringPool::Handle text)
+            : text_(std::move(text)) {
+        }
+
+        std::unique_ptr<Impl> Clone(int /* row_offset */, int /* col_offset */) const override {
+            return std::make_unique<TextImpl>(text_);
         }
 
         std::vector<Position> GetReferencedCells() const override {
@@ -59,81 +146,342 @@ namespace detail {
         }
 
         std::string GetText() const noexcept override {
-            return text_;
+            return std::string(*text_);
+        }
+
+        std::string_view GetTextView() const noexcept override {
+            return *text_;
         }
 
         Value GetValue() const override {
-            if (text_.front() == ESCAPE_SIGN) {
-                return text_.substr(1, text_.size() - 1);
+            return std::string(std::get<std::string_view>(GetValueView()));
+        }
+
+        ValueView GetValueView() const override {
+            std::string_view text = *text_;
+
+            if (text.front() == ESCAPE_SIGN) {
+                text.remove_prefix(1);
             }
 
-            return text_;
+            return text;
         }
 
     private:
-        std::string text_;
+        StringPool::Handle text_;
+    };
+
+    // A number stored unboxed. It reads as the text the number is written with, exactly like
+    // a numeric text cell, but the text is only formatted once something asks for it and
+    // formulas take the number without parsing.
+    class NumberImpl final : public Impl {
+    public:
+        // the value must be finite, as formulas never read the other texts as numbers
+        explicit NumberImpl(double number) noexcept
+            : number_(number) {
+        }
+
+        std::unique_ptr<Impl> Clone(int /* row_offset */, int /* col_offset */) const override {
+            return std::make_unique<NumberImpl>(number_);
+        }
+
+        std::optional<double> GetNumber() const noexcept override {
+            return number_;
+        }
+
+        std::vector<Position> GetReferencedCells() const override {
+            return {};
+        }
+
+        std::string GetText() const noexcept override {
+            return std::string(GetTextView());
+        }
+
+        std::string_view GetTextView() const noexcept override {
+            // the shortest text reading back as the same number
+            std::call_once(formatted_, [this] {
+                text_length_ = static_cast<std::uint8_t>(std::to_chars(text_, text_ + MAX_TEXT_LENGTH, number_).ptr - text_);
+            });
+
+            return { text_, text_length_ };
+        }
+
+        Value GetValue() const override {
+            return GetText();
+        }
+
+        ValueView GetValueView() const override {
+            return GetTextView();
+        }
+
+        // the same number keeps its date without formatting either text
+        void Stamp(const Impl* previous, std::uint64_t revision) override {
+            changed_at_ = revision;
+
+            if (previous == nullptr) {
+                return;
+            }
+
+            // bitwise, as zero and negative zero are written differently
+            if (std::optional<double> previous_number = previous->GetNumber();
+                previous_number && std::memcmp(&*previous_number, &number_, sizeof(double)) == 0) {
+
+                changed_at_ = previous->GetChangedAt();
+            }
+        }
+
+    private:
+        static constexpr std::size_t MAX_TEXT_LENGTH = 32;
+
+        double number_;
+        mutable std::once_flag formatted_;
+        mutable char text_[MAX_TEXT_LENGTH];
+        mutable std::uint8_t text_length_ = 0;
     };
 
     class FormulaImpl final : public Impl {
     public:
-        FormulaImpl(std::string text, const SheetInterface& spreadsheet)
-            : formula_(ParseFormula(text.substr(1, text.size() - 1))) 
-            , spreadsheet_(spreadsheet) {
+        FormulaImpl(std::string_view text, const Sheet& spreadsheet, Profiler& profiler)
+            : formula_(ParseFormula(std::string(text.substr(1)))) 
+            , text_(FORMULA_SIGN + formula_->GetExpression())
+            , spreadsheet_(spreadsheet)
+            , profiler_(profiler) {
+        }
+
+        FormulaImpl(std::unique_ptr<FormulaInterface> formula, const Sheet& spreadsheet, Profiler& profiler)
+            : formula_(std::move(formula))
+            , text_(FORMULA_SIGN + formula_->GetExpression())
+            , spreadsheet_(spreadsheet)
+            , profiler_(profiler) {
+        }
+
+        const FormulaImpl* AsFormula() const noexcept override {
+            return this;
+        }
+
+        std::unique_ptr<Impl> Clone(int row_offset, int col_offset) const override {
+            return std::make_unique<FormulaImpl>(formula_->Clone(row_offset, col_offset), spreadsheet_, profiler_);
+        }
+
+        // drops the current value from the budgeted cache, keeping it to compare the next result
+        // with; returns false if the value is not current
+        bool Evict() const noexcept {
+            CacheState expected = CacheState::Done;
+            return cache_state_.compare_exchange_strong(expected, CacheState::Evicted, std::memory_order_relaxed);
+        }
+
+        const FormulaProgram& GetProgram() const noexcept {
+            return formula_->GetProgram();
         }
 
         std::vector<Position> GetReferencedCells() const override {
             return formula_->GetReferencedCells();
         }
 
+        std::forward_list<CellReference>* GetReferences() noexcept override {
+            return &formula_->GetReferences();
+        }
+
         std::string GetText() const noexcept override {
-            return "=" + formula_->GetExpression();
+            return text_;
+        }
+
+        std::string_view GetTextView() const noexcept override {
+            return text_;
         }
 
         Value GetValue() const override {
-            if (!cache_.has_value()) {
-                cache_ = formula_->Evaluate(spreadsheet_);
+            return std::visit([](auto value) -> Value {
+                return value;
+            }, GetCachedValue());
+        }
+
+        ValueView GetValueView() const override {
+            return std::visit([](auto value) -> ValueView {
+                return value;
+            }, GetCachedValue());
+        }
+
+        void InvalidateCache() noexcept override {
+            cache_state_.store(CacheState::Dirty, std::memory_order_release);
+        }
+
+        bool IsCurrent() const noexcept {
+            return cache_state_.load(std::memory_order_acquire) == CacheState::Done;
+        }
+
+        // an input changed since the value was evaluated, unlike a stale formula, which may still be current
+        bool IsDirty() const noexcept {
+            return cache_state_.load(std::memory_order_acquire) == CacheState::Dirty;
+        }
+
+        // an input changed; returns false if the cell was already marked, in which case so are its dependents
+        bool MarkDirty() noexcept {
+            const CacheState state = cache_state_.load(std::memory_order_relaxed);
+            cache_state_.store(CacheState::Dirty, std::memory_order_release);
+
+            return state == CacheState::Done || state == CacheState::Evicted;
+        }
+
+        // an input may have changed; returns false if the cell was already marked,
+        // in which case so are its dependents
+        bool MarkStale() noexcept {
+            if (const CacheState state = cache_state_.load(std::memory_order_relaxed);
+                state != CacheState::Done && state != CacheState::Evicted) {
+
+                return false;
             }
 
-            if (std::holds_alternative<double>(cache_.value())) {
-                return std::get<double>(cache_.value());
+            cache_state_.store(CacheState::Stale, std::memory_order_release);
+            return true;
+        }
+
+        std::optional<Value> PeekValue() const override {
+            if (const CacheState state = cache_state_.load(std::memory_order_acquire);
+                state != CacheState::Done && state != CacheState::Evicted) {
+
+                return std::nullopt;
             }
 
-            return std::get<FormulaError>(cache_.value());
+            return std::visit([](auto value) -> Value {
+                return value;
+            }, cache_);
         }
 
-        void InvalidateCache() noexcept {
-            cache_.reset();
+        // makes the value evaluated for a formula taken with TryClaim current
+        void Publish(const FormulaInterface::Value& value) const noexcept;
+
+        // returns whether any reference was deleted
+        bool ShiftReferences(const PositionShift& shift) {
+            const bool reference_deleted = formula_->ShiftReferences(shift);
+            text_ = FORMULA_SIGN + formula_->GetExpression();
+
+            return reference_deleted;
+        }
+
+        // keeps the previous value to compare the first result with
+        void Stamp(const Impl* previous, std::uint64_t revision) override {
+            changed_at_ = revision;
+
+            if (previous == nullptr) {
+                return;
+            }
+
+            if (std::optional<Value> previous_value = previous->PeekValue(); previous_value) {
+                if (const double* number = std::get_if<double>(&*previous_value)) {
+                    cache_ = *number;
+                    changed_at_ = previous->GetChangedAt();
+                }
+                else if (const FormulaError* error = std::get_if<FormulaError>(&*previous_value)) {
+                    cache_ = *error;
+                    changed_at_ = previous->GetChangedAt();
+                }
+            }
+        }
+
+        // takes a dirty formula over to be evaluated outside of it, as a batch of them is, until
+        // Publish; returns false if the formula is not dirty anymore
+        bool TryClaim() const noexcept {
+            CacheState expected = CacheState::Dirty;
+            return cache_state_.compare_exchange_strong(expected, CacheState::Computing, std::memory_order_acquire);
         }
 
     private:
-        std::unique_ptr<FormulaInterface> formula_;
-        const SheetInterface& spreadsheet_;
+        // Dirty, Stale or Evicted -> Computing -> Done: the thread winning the first transition
+        // evaluates, the others wait for it and reuse the result. A stale formula is evaluated only
+        // if some input changed after it was last verified, and keeps its date if the result is the
+        // same. An evicted value is still current, the inputs invalidate it as a done one, but it is
+        // evaluated again when read
+        enum class CacheState : std::uint8_t {
+            Dirty,
+            Stale,
+            Computing,
+            Done,
+            Evicted,
+        };
+
+        const FormulaInterface::Value& GetCachedValue() const;
+        // brings the inputs up to date, returns whether any changed after the last verification
+        bool InputsChanged() const;
+        // takes a freshly evaluated value, the cell being in the Computing state
+        void Store(const FormulaInterface::Value& value) const;
 
-        mutable std::optional<std::variant<double, FormulaError>> cache_;
+        std::unique_ptr<FormulaInterface> formula_;
+        std::string text_;
+        // evaluates the formula and dates its values
+        const Sheet& spreadsheet_;
+        Profiler& profiler_;
+
+        mutable std::atomic<CacheState> cache_state_ = CacheState::Dirty;
+        mutable FormulaInterface::Value cache_ = 0.0;
+        // the sheet revision at which the cached value was last known to be current
+        mutable std::uint64_t verified_at_ = 0;
     };
 } // namespace detail
 
-class Sheet;
-
 class Cell final : public CellInterface {
 public:
-    Cell(Sheet& spreadsheet);
+    Cell(Sheet& spreadsheet, Position pos);
     ~Cell() noexcept;
 
-    void Clear() noexcept;
+    // empties the cell, which then only stays in the sheet while other cells reference it;
+    // returns the replaced contents
+    std::unique_ptr<detail::Impl> Clear();
+    // the contents to paste at the given offset, nullptr for a placeholder
+    std::unique_ptr<detail::Impl> CloneContents(int row_offset, int col_offset) const;
+    // unlinks a cell deleted with its row or column, returns the cells it referenced
+    std::vector<Cell*> Detach();
+    // the sheet revision at which the value last changed, valid once the value is evaluated
+    std::uint64_t GetChangedAt() const noexcept;
+    Position GetPosition() const noexcept;
+    // nullptr unless the cell holds a formula
+    const detail::FormulaImpl* GetFormula() const noexcept;
     std::vector<Position> GetReferencedCells() const override;
     std::string GetText() const noexcept override;
+    std::string_view GetTextView() const noexcept override;
+    std::optional<double> GetNumber() const noexcept override;
+    const std::unordered_set<Cell*>& GetUpperLevel() const noexcept;
     Value GetValue() const override;
+    ValueView GetValueView() const override;
     bool HasUpperLevel() const;
-    void Set(std::string text);
+    // marks everything depending on the freshly set cells as stale, visiting each dependent once;
+    // returns the number of marked cells
+    static std::size_t InvalidateDependents(const std::vector<Cell*>& cells);
+    // an empty cell kept only because formulas reference it
+    bool IsPlaceholder() const noexcept;
+    // returns the replaced contents
+    std::unique_ptr<detail::Impl> MakePlaceholder();
+    // the value if it is known without evaluating anything
+    std::optional<Value> PeekValue() const;
+    // the contents the text sets, unchecked for cycles; throws FormulaException
+    static std::unique_ptr<detail::Impl> Parse(Sheet& spreadsheet, std::string text);
+    // returns the replaced contents, nullptr when the text is unchanged or the cell is new
+    std::unique_ptr<detail::Impl> Set(std::string text);
+    // the number must be finite; returns the replaced contents, nullptr when the cell is new
+    std::unique_ptr<detail::Impl> SetNumber(double number);
+    // installs pasted or restored contents, nullptr making a placeholder, without checking
+    // for cycles or invalidating the dependents; returns the replaced contents
+    std::unique_ptr<detail::Impl> SetContents(std::unique_ptr<detail::Impl> impl);
+    void SetPosition(Position pos) noexcept;
+    // rewrites the references of a formula after rows or columns were inserted or deleted
+    void ShiftReferences(const PositionShift& shift);
 
 private:
-    void AdjustCellsDependency(const detail::Impl* const being_considered_impl);
+    // links the referenced cells, creating placeholders for the empty ones, and binds the references to them
+    void AdjustCellsDependency(detail::Impl* being_considered_impl);
     bool CheckOnCyclicDependency(const detail::Impl* const being_considered_impl);
-    void InvalidateCache(const std::unordered_set<Cell*>& to_invalidate);
+    // marks the dependents as stale, stopping at the ones already marked; returns the number of marked cells
+    std::size_t InvalidateCache(const std::unordered_set<Cell*>& to_invalidate);
+    // marks the dependents after the contents were replaced, unless the value stayed the same;
+    // returns the number of marked cells
+    std::size_t InvalidateUpperLevel(bool changed);
+    // dates the new contents, returns whether the value changed
+    bool Stamp(const detail::Impl* previous_impl);
 
     std::unique_ptr<detail::Impl> impl_;
     Sheet& spreadsheet_;
+    Position pos_;
+    bool is_placeholder_ = false;
 
     std::unordered_set<Cell*> upper_level_;
     std::unordered_set<Cell*> lower_level_;
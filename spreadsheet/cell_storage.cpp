@@ -0,0 +1,401 @@
+#include <algorithm>
+#include <iterator>
+
+#include "cell.h"
+#include "cell_storage.h"
+
+namespace {
+    // rows with fewer cells are never promoted
+    const int MIN_DENSE_CELLS = 16;
+
+    bool ShouldBeDense(int count, int span) {
+        return count >= MIN_DENSE_CELLS && count * 2 >= span;
+    }
+
+    bool ShouldBeSparse(int count, int span) {
+        return count < MIN_DENSE_CELLS / 2 || count * 8 < span;
+    }
+
+    template <typename Entries>
+    auto FindColumn(Entries& entries, int col) {
+        return std::lower_bound(entries.begin(), entries.end(), col, [](const auto& entry, int col) {
+            return entry.first < col;
+        });
+    }
+} // unnamed namespace
+
+CellStorage::Row::Row() = default;
+CellStorage::Row::Row(Row&&) noexcept = default;
+CellStorage::Row& CellStorage::Row::operator=(Row&&) noexcept = default;
+CellStorage::Row::~Row() noexcept = default;
+
+void CellStorage::Row::Compact() {
+    if (IsDense()) {
+        auto first_cell = std::find_if(dense_.begin(), dense_.end(), [](const auto& cell) {
+            return cell != nullptr;
+        });
+        const int leading = static_cast<int>(first_cell - dense_.begin());
+
+        dense_.erase(dense_.begin(), first_cell);
+        dense_first_col_ += leading;
+        dense_.resize(GetEnd() - dense_first_col_);
+    }
+
+    sparse_.shrink_to_fit();
+    dense_.shrink_to_fit();
+}
+
+void CellStorage::Row::Erase(int col) {
+    if (IsDense()) {
+        const int index = col - dense_first_col_;
+
+        if (index < 0 || index >= static_cast<int>(dense_.size()) || dense_[index] == nullptr) {
+            return;
+        }
+
+        dense_[index].reset();
+        --count_;
+
+        if (ShouldBeSparse(count_, static_cast<int>(dense_.size()))) {
+            Demote();
+        }
+
+        return;
+    }
+
+    if (auto taken_cell = FindColumn(sparse_, col); taken_cell != sparse_.end() && taken_cell->first == col) {
+        sparse_.erase(taken_cell);
+        --count_;
+
+        // dropping an outlying cell may narrow the span enough
+        if (count_ > 0 && ShouldBeDense(count_, sparse_.back().first - sparse_.front().first + 1)) {
+            Promote();
+        }
+    }
+}
+
+Cell* CellStorage::Row::Find(int col) const noexcept {
+    if (IsDense()) {
+        const int index = col - dense_first_col_;
+
+        if (index < 0 || index >= static_cast<int>(dense_.size())) {
+            return nullptr;
+        }
+
+        return dense_[index].get();
+    }
+
+    if (auto taken_cell = FindColumn(sparse_, col); taken_cell != sparse_.end() && taken_cell->first == col) {
+        return taken_cell->second.get();
+    }
+
+    return nullptr;
+}
+
+Cell& CellStorage::Row::Insert(int col, std::unique_ptr<Cell> cell) {
+    Cell& inserted = *cell;
+
+    if (IsDense()) {
+        const int first_col = std::min(dense_first_col_, col);
+        const int end_col = std::max(dense_first_col_ + static_cast<int>(dense_.size()), col + 1);
+
+        if (ShouldBeSparse(count_ + 1, end_col - first_col)) {
+            Demote();
+        }
+        else {
+            if (first_col < dense_first_col_) {
+                std::vector<std::unique_ptr<Cell>> dense(end_col - first_col);
+                std::move(dense_.begin(), dense_.end(), dense.begin() + (dense_first_col_ - first_col));
+
+                dense_ = std::move(dense);
+                dense_first_col_ = first_col;
+            }
+            else {
+                dense_.resize(end_col - first_col);
+            }
+
+            dense_[col - dense_first_col_] = std::move(cell);
+            ++count_;
+            return inserted;
+        }
+    }
+
+    sparse_.emplace(FindColumn(sparse_, col), col, std::move(cell));
+    ++count_;
+
+    if (ShouldBeDense(count_, sparse_.back().first - sparse_.front().first + 1)) {
+        Promote();
+    }
+
+    return inserted;
+}
+
+void CellStorage::Row::Shift(int first_col, int count) {
+    if (IsDense()) {
+        const int size = static_cast<int>(dense_.size());
+        const int index = first_col - dense_first_col_;
+
+        if (count < 0) {
+            auto from = dense_.begin() + std::clamp(index, 0, size);
+            auto to = dense_.begin() + std::clamp(index - count, 0, size);
+
+            count_ -= static_cast<int>(std::count_if(from, to, [](const auto& cell) {
+                return cell != nullptr;
+            }));
+            dense_.erase(from, to);
+
+            if (dense_first_col_ >= first_col - count) {
+                dense_first_col_ += count;
+            }
+            else if (dense_first_col_ > first_col) {
+                dense_first_col_ = first_col;
+            }
+
+            if (count_ == 0) {
+                dense_.clear();
+            }
+            else if (ShouldBeSparse(count_, GetEnd() - dense_first_col_)) {
+                Demote();
+            }
+
+            return;
+        }
+
+        if (index <= 0) {
+            dense_first_col_ += count;
+            return;
+        }
+
+        if (index >= size) {
+            return;
+        }
+
+        if (!ShouldBeSparse(count_, size + count)) {
+            std::vector<std::unique_ptr<Cell>> gap(count);
+            dense_.insert(dense_.begin() + index, std::make_move_iterator(gap.begin()), std::make_move_iterator(gap.end()));
+            return;
+        }
+
+        // the gap would leave the row too empty
+        Demote();
+    }
+
+    auto shifted = FindColumn(sparse_, first_col);
+
+    if (count < 0) {
+        auto deleted_end = FindColumn(sparse_, first_col - count);
+        count_ -= static_cast<int>(deleted_end - shifted);
+        shifted = sparse_.erase(shifted, deleted_end);
+    }
+
+    for (; shifted != sparse_.end(); ++shifted) {
+        shifted->first += count;
+    }
+
+    // deleting columns may narrow the span enough
+    if (count_ > 0 && ShouldBeDense(count_, sparse_.back().first - sparse_.front().first + 1)) {
+        Promote();
+    }
+}
+
+int CellStorage::Row::GetCellCount() const noexcept {
+    return count_;
+}
+
+int CellStorage::Row::GetEnd() const noexcept {
+    if (count_ == 0) {
+        return 0;
+    }
+
+    if (IsDense()) {
+        auto last_cell = std::find_if(dense_.rbegin(), dense_.rend(), [](const auto& cell) {
+            return cell != nullptr;
+        });
+
+        return dense_first_col_ + static_cast<int>(dense_.rend() - last_cell);
+    }
+
+    return sparse_.back().first + 1;
+}
+
+std::size_t CellStorage::Row::GetStorageBytes() const noexcept {
+    return sizeof(Row) + sparse_.capacity() * sizeof(sparse_.front()) + dense_.capacity() * sizeof(dense_.front());
+}
+
+bool CellStorage::Row::IsDense() const noexcept {
+    return !dense_.empty();
+}
+
+void CellStorage::Row::Demote() {
+    std::vector<std::pair<int, std::unique_ptr<Cell>>> sparse;
+    sparse.reserve(count_ + 1);
+
+    for (std::size_t i = 0; i < dense_.size(); ++i) {
+        if (dense_[i] != nullptr) {
+            sparse.emplace_back(dense_first_col_ + static_cast<int>(i), std::move(dense_[i]));
+        }
+    }
+
+    sparse_ = std::move(sparse);
+    dense_.clear();
+    dense_.shrink_to_fit();
+}
+
+void CellStorage::Row::Promote() {
+    const int first_col = sparse_.front().first;
+    std::vector<std::unique_ptr<Cell>> dense(sparse_.back().first - first_col + 1);
+
+    for (auto& [col, cell] : sparse_) {
+        dense[col - first_col] = std::move(cell);
+    }
+
+    dense_ = std::move(dense);
+    dense_first_col_ = first_col;
+    sparse_.clear();
+    sparse_.shrink_to_fit();
+}
+
+CellStorage::CellStorage() = default;
+CellStorage::~CellStorage() noexcept = default;
+
+void CellStorage::Compact() {
+    while (!rows_.empty() && rows_.back() == nullptr) {
+        rows_.pop_back();
+    }
+    rows_.shrink_to_fit();
+
+    for (const auto& row : rows_) {
+        if (row != nullptr) {
+            row->Compact();
+        }
+    }
+}
+
+void CellStorage::Erase(Position pos) {
+    if (pos.row >= static_cast<int>(rows_.size()) || rows_[pos.row] == nullptr) {
+        return;
+    }
+
+    Row& row = *rows_[pos.row];
+    const int count = row.GetCellCount();
+    row.Erase(pos.col);
+    cell_count_ -= count - row.GetCellCount();
+
+    if (row.GetCellCount() == 0) {
+        rows_[pos.row].reset();
+    }
+}
+
+Cell* CellStorage::Find(Position pos) const noexcept {
+    if (pos.row >= static_cast<int>(rows_.size()) || rows_[pos.row] == nullptr) {
+        return nullptr;
+    }
+
+    return rows_[pos.row]->Find(pos.col);
+}
+
+Cell& CellStorage::Insert(Position pos, std::unique_ptr<Cell> cell) {
+    if (pos.row >= static_cast<int>(rows_.size())) {
+        rows_.resize(pos.row + 1);
+    }
+
+    if (rows_[pos.row] == nullptr) {
+        rows_[pos.row] = std::make_unique<Row>();
+    }
+
+    Cell& inserted = rows_[pos.row]->Insert(pos.col, std::move(cell));
+    ++cell_count_;
+
+    return inserted;
+}
+
+void CellStorage::Shift(const PositionShift& shift) {
+    if (shift.axis == PositionShift::Axis::Cols) {
+        for (auto& row : rows_) {
+            if (row == nullptr) {
+                continue;
+            }
+
+            const int count = row->GetCellCount();
+            row->Shift(shift.first, shift.count);
+            cell_count_ -= count - row->GetCellCount();
+
+            if (row->GetCellCount() == 0) {
+                row.reset();
+            }
+        }
+
+        return;
+    }
+
+    if (shift.first >= static_cast<int>(rows_.size())) {
+        return;
+    }
+
+    auto first_row = rows_.begin() + shift.first;
+
+    if (shift.count < 0) {
+        auto deleted_end = rows_.begin() + std::min(shift.first - shift.count, static_cast<int>(rows_.size()));
+
+        for (auto row = first_row; row != deleted_end; ++row) {
+            if (*row != nullptr) {
+                cell_count_ -= (*row)->GetCellCount();
+            }
+        }
+
+        rows_.erase(first_row, deleted_end);
+    }
+    else {
+        std::vector<std::unique_ptr<Row>> gap(shift.count);
+        rows_.insert(first_row, std::make_move_iterator(gap.begin()), std::make_move_iterator(gap.end()));
+    }
+}
+
+std::size_t CellStorage::GetAllocatedRowCount() const noexcept {
+    return std::count_if(rows_.begin(), rows_.end(), [](const auto& row) {
+        return row != nullptr;
+    });
+}
+
+std::size_t CellStorage::GetCellCount() const noexcept {
+    return cell_count_;
+}
+
+std::size_t CellStorage::GetDenseRowCount() const noexcept {
+    return std::count_if(rows_.begin(), rows_.end(), [](const auto& row) {
+        return row != nullptr && row->IsDense();
+    });
+}
+
+Size CellStorage::GetPrintableSize() const noexcept {
+    Size size;
+
+    for (std::size_t row = 0; row < rows_.size(); ++row) {
+        if (rows_[row] != nullptr) {
+            size.rows = static_cast<int>(row) + 1;
+            size.cols = std::max(size.cols, rows_[row]->GetEnd());
+        }
+    }
+
+    return size;
+}
+
+int CellStorage::GetRowEnd() const noexcept {
+    return static_cast<int>(rows_.size());
+}
+
+std::size_t CellStorage::GetStorageBytes() const noexcept {
+    std::size_t bytes = rows_.capacity() * sizeof(rows_.front()) + cell_count_ * sizeof(Cell);
+
+    for (const auto& row : rows_) {
+        if (row != nullptr) {
+            bytes += row->GetStorageBytes();
+        }
+    }
+
+    return bytes;
+}
+
+bool CellStorage::IsRowDense(int row) const noexcept {
+    return row < static_cast<int>(rows_.size()) && rows_[row] != nullptr && rows_[row]->IsDense();
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+
+class Cell;
+
+// Row-wise cell storage. A row starts sparse, as column-sorted pairs holding only
+// the occupied cells, and is promoted to a dense array spanning its first to last
+// occupied column once it is at least half full; a dense row falling under
+// an eighth of occupancy is demoted back. Cells never move in memory.
+class CellStorage final {
+public:
+    CellStorage();
+    CellStorage(const CellStorage&) = delete;
+    CellStorage& operator=(const CellStorage&) = delete;
+    ~CellStorage() noexcept;
+
+    // trims unused rows and columns and returns the spare capacity
+    void Compact();
+    void Erase(Position pos);
+    Cell* Find(Position pos) const noexcept;
+    // the position must not be occupied
+    Cell& Insert(Position pos, std::unique_ptr<Cell> cell);
+    // destroys the cells of deleted rows or columns and moves the following ones in bulk,
+    // leaving the positions stored in the cells to the caller
+    void Shift(const PositionShift& shift);
+
+    std::size_t GetAllocatedRowCount() const noexcept;
+    std::size_t GetCellCount() const noexcept;
+    std::size_t GetDenseRowCount() const noexcept;
+    Size GetPrintableSize() const noexcept;
+    // one past the last row holding cells, or having held them since the storage was last compacted
+    int GetRowEnd() const noexcept;
+    std::size_t GetStorageBytes() const noexcept;
+    bool IsRowDense(int row) const noexcept;
+
+    // calls func(Position, const Cell&) for every cell in row-major order
+    template <typename Func>
+    void ForEach(Func func) const;
+    // calls func(Position, const Cell&) for every cell inside the block in row-major order,
+    // skipping the empty positions without probing them
+    template <typename Func>
+    void ForEachInRange(Position first, Size size, Func func) const;
+    // calls func(Position, Cell&) for every cell moved or deleted by the shift
+    template <typename Func>
+    void ForEachShifted(const PositionShift& shift, Func func);
+
+private:
+    class Row final {
+    public:
+        Row();
+        Row(Row&&) noexcept;
+        Row& operator=(Row&&) noexcept;
+        ~Row() noexcept;
+
+        void Compact();
+        void Erase(int col);
+        Cell* Find(int col) const noexcept;
+        Cell& Insert(int col, std::unique_ptr<Cell> cell);
+        void Shift(int first_col, int count);
+
+        int GetCellCount() const noexcept;
+        // one past the last occupied column, zero for an empty row
+        int GetEnd() const noexcept;
+        std::size_t GetStorageBytes() const noexcept;
+        bool IsDense() const noexcept;
+
+        template <typename Func>
+        void ForEach(Func&& func) const;
+        template <typename Func>
+        void ForEachFrom(int first_col, Func&& func);
+        template <typename Func>
+        void ForEachIn(int first_col, int end_col, Func&& func) const;
+
+    private:
+        void Demote();
+        void Promote();
+
+        std::vector<std::pair<int, std::unique_ptr<Cell>>> sparse_;
+        std::vector<std::unique_ptr<Cell>> dense_;
+        int dense_first_col_ = 0;
+        int count_ = 0;
+    };
+
+    std::vector<std::unique_ptr<Row>> rows_;
+    std::size_t cell_count_ = 0;
+};
+
+template <typename Func>
+void CellStorage::Row::ForEach(Func&& func) const {
+    if (IsDense()) {
+        for (std::size_t i = 0; i < dense_.size(); ++i) {
+            if (dense_[i] != nullptr) {
+                func(dense_first_col_ + static_cast<int>(i), *dense_[i]);
+            }
+        }
+
+        return;
+    }
+
+    for (const auto& [col, cell] : sparse_) {
+        func(col, *cell);
+    }
+}
+
+template <typename Func>
+void CellStorage::Row::ForEachFrom(int first_col, Func&& func) {
+    if (IsDense()) {
+        for (std::size_t i = std::max(first_col - dense_first_col_, 0); i < dense_.size(); ++i) {
+            if (dense_[i] != nullptr) {
+                func(dense_first_col_ + static_cast<int>(i), *dense_[i]);
+            }
+        }
+
+        return;
+    }
+
+    for (auto& [col, cell] : sparse_) {
+        if (col >= first_col) {
+            func(col, *cell);
+        }
+    }
+}
+
+template <typename Func>
+void CellStorage::Row::ForEachIn(int first_col, int end_col, Func&& func) const {
+    if (IsDense()) {
+        const int end = std::min(end_col - dense_first_col_, static_cast<int>(dense_.size()));
+
+        for (int i = std::max(first_col - dense_first_col_, 0); i < end; ++i) {
+            if (dense_[i] != nullptr) {
+                func(dense_first_col_ + i, *dense_[i]);
+            }
+        }
+
+        return;
+    }
+
+    auto cell = std::lower_bound(sparse_.begin(), sparse_.end(), first_col, [](const auto& entry, int col) {
+        return entry.first < col;
+    });
+
+    for (; cell != sparse_.end() && cell->first < end_col; ++cell) {
+        func(cell->first, *cell->second);
+    }
+}
+
+template <typename Func>
+void CellStorage::ForEach(Func func) const {
+    for (std::size_t row = 0; row < rows_.size(); ++row) {
+        if (rows_[row] != nullptr) {
+            rows_[row]->ForEach([&func, row](int col, const Cell& cell) {
+                func(Position{ static_cast<int>(row), col }, cell);
+            });
+        }
+    }
+}
+
+template <typename Func>
+void CellStorage::ForEachInRange(Position first, Size size, Func func) const {
+    const int end_row = std::min(first.row + size.rows, static_cast<int>(rows_.size()));
+
+    for (int row = first.row; row < end_row; ++row) {
+        if (rows_[row] != nullptr) {
+            rows_[row]->ForEachIn(first.col, first.col + size.cols, [&func, row](int col, const Cell& cell) {
+                func(Position{ row, col }, cell);
+            });
+        }
+    }
+}
+
+template <typename Func>
+void CellStorage::ForEachShifted(const PositionShift& shift, Func func) {
+    const bool shifts_rows = shift.axis == PositionShift::Axis::Rows;
+
+    for (std::size_t row = shifts_rows ? shift.first : 0; row < rows_.size(); ++row) {
+        if (rows_[row] != nullptr) {
+            rows_[row]->ForEachFrom(shifts_rows ? 0 : shift.first, [&func, row](int col, Cell& cell) {
+                func(Position{ static_cast<int>(row), col }, cell);
+            });
+        }
+    }
+}
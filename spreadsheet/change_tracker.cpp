@@ -0,0 +1,94 @@
+#include <algorithm>
+
+#include "cell.h"
+#include "change_tracker.h"
+
+ChangeTracker::ChangeTracker() = default;
+ChangeTracker::~ChangeTracker() noexcept = default;
+
+bool ChangeTracker::Observation::operator==(const Observation& rhs) const {
+    if (state == State::Unknown || rhs.state == State::Unknown) {
+        // no value was shown to compare with, so only the recomputation tells whether it moved
+        return state != State::Empty && rhs.state != State::Empty && changed_at == rhs.changed_at;
+    }
+
+    return state == rhs.state && (state == State::Empty || value == rhs.value);
+}
+
+void ChangeTracker::Begin() noexcept {
+    ++depth_;
+}
+
+void ChangeTracker::Commit(const SheetInterface& sheet) {
+    if (depth_ > 0 && --depth_ == 0) {
+        Flush(sheet);
+    }
+}
+
+void ChangeTracker::Flush(const SheetInterface& sheet) {
+    if (depth_ > 0 || pending_.empty()) {
+        return;
+    }
+
+    Changes changes;
+
+    for (const auto& [pos, before] : pending_) {
+        const Observation after = Observe(static_cast<const Cell*>(sheet.GetCell(pos)));
+
+        if (after.state == Observation::State::Unknown) {
+            // one pending before the batch was reported then, and has not been read since
+            if (before.state != Observation::State::Unknown) {
+                changes.pending.push_back(pos);
+            }
+        }
+        else if (!(after == before)) {
+            changes.changed.push_back(pos);
+        }
+    }
+
+    pending_.clear();
+
+    if (changes.changed.empty() && changes.pending.empty()) {
+        return;
+    }
+
+    std::sort(changes.changed.begin(), changes.changed.end());
+    std::sort(changes.pending.begin(), changes.pending.end());
+
+    for (const auto& [id, callback] : subscribers_) {
+        callback(changes);
+    }
+}
+
+ChangeTracker::SubscriptionId ChangeTracker::Subscribe(Callback callback) {
+    subscribers_.emplace_back(next_id_, std::move(callback));
+    return next_id_++;
+}
+
+void ChangeTracker::Unsubscribe(SubscriptionId id) {
+    subscribers_.erase(std::remove_if(subscribers_.begin(), subscribers_.end(), [id](const auto& subscriber) {
+        return subscriber.first == id;
+    }), subscribers_.end());
+
+    if (subscribers_.empty()) {
+        pending_.clear();
+    }
+}
+
+ChangeTracker::Observation ChangeTracker::Observe(const Cell* cell) {
+    if (cell == nullptr || cell->IsPlaceholder()) {
+        return {};
+    }
+
+    if (auto value = cell->PeekValue()) {
+        return { Observation::State::Known, std::move(*value), cell->GetChangedAt() };
+    }
+
+    return { Observation::State::Unknown, {}, cell->GetChangedAt() };
+}
+
+void ChangeTracker::TrackSlow(Position pos, const Cell* cell) {
+    if (!pending_.count(pos)) {
+        pending_.emplace(pos, Observe(cell));
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+
+class Cell;
+
+// Tells subscribers which cells show a different value after an edit or a transaction.
+// The edits and the invalidation pass report each touched position with the value it
+// showed before; once the batch ends, the touched cells are compared without evaluating
+// anything, so that the recalculation stays as lazy as it was. The formulas an edit left
+// waiting for recomputation are reported apart as pending: their values are only known once
+// they are read, and they are not reported again until they are. A formula that was pending
+// and got evaluated during the batch counts as changed only if the recomputation moved its date.
+// While nobody is subscribed every hook returns right away.
+class ChangeTracker final {
+public:
+    // each list is sorted
+    struct Changes final {
+        std::vector<Position> changed;
+        // formulas not evaluated since their inputs changed
+        std::vector<Position> pending;
+    };
+
+    // must neither edit the sheet nor change the subscriptions
+    using Callback = std::function<void(const Changes& changes)>;
+    using SubscriptionId = std::uint64_t;
+
+    ChangeTracker();
+    ChangeTracker(const ChangeTracker&) = delete;
+    ChangeTracker& operator=(const ChangeTracker&) = delete;
+    ~ChangeTracker() noexcept;
+
+    // nested batches join the outermost one
+    void Begin() noexcept;
+    void Commit(const SheetInterface& sheet);
+    // delivers the changes unless a batch is open
+    void Flush(const SheetInterface& sheet);
+    SubscriptionId Subscribe(Callback callback);
+    // the cell at the position, if any, is about to change; only the first report in a batch counts
+    void Track(Position pos, const Cell* cell);
+    void Unsubscribe(SubscriptionId id);
+
+private:
+    struct Observation final {
+        enum class State : std::uint8_t {
+            Empty,
+            Known,
+            // a formula not evaluated since its last change
+            Unknown,
+        };
+
+        State state = State::Empty;
+        CellInterface::Value value;
+        // the sheet revision at which the value last changed
+        std::uint64_t changed_at = 0;
+
+        bool operator==(const Observation& rhs) const;
+    };
+
+    static Observation Observe(const Cell* cell);
+    void TrackSlow(Position pos, const Cell* cell);
+
+    std::unordered_map<Position, Observation, PositionHasher> pending_;
+    std::vector<std::pair<SubscriptionId, Callback>> subscribers_;
+    SubscriptionId next_id_ = 0;
+    int depth_ = 0;
+};
+
+inline void ChangeTracker::Track(Position pos, const Cell* cell) {
+    if (!subscribers_.empty()) {
+        TrackSlow(pos, cell);
+    }
+}
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstddef>
 #include <iosfwd>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -16,15 +18,40 @@ struct Position final {
     bool operator<(Position rhs) const;
 
     bool IsValid() const noexcept;
+    // writes the position without a terminating null, returns the number of written chars;
+    // the buffer must hold at least MAX_POSITION_LENGTH chars
+    std::size_t ToChars(char* buffer) const noexcept;
     std::string ToString() const;
 
     static Position FromString(std::string_view str);
 
     static const int MAX_ROWS = 16384;
     static const int MAX_COLS = 16384;
+    static const int MAX_POSITION_LENGTH = 17;
     static const Position NONE;
 };
 
+struct PositionHasher final {
+    std::size_t operator()(Position pos) const noexcept;
+};
+
+// Insertion (count > 0) or deletion (count < 0) of whole rows or columns starting at first
+struct PositionShift final {
+    enum class Axis {
+        Rows,
+        Cols,
+    };
+
+    Axis axis = Axis::Rows;
+    int first = 0;
+    int count = 0;
+
+    // whether the position is moved or deleted
+    bool Affects(Position pos) const noexcept;
+    // NONE for a deleted position
+    Position Apply(Position pos) const noexcept;
+};
+
 struct Size final {
     int rows = 0;
     int cols = 0;
@@ -70,12 +97,30 @@ public:
 class CellInterface {
 public:
     using Value = std::variant<std::string, double, FormulaError>;
+    // non-owning counterpart of Value, stays valid until the cell is modified
+    using ValueView = std::variant<std::string_view, double, FormulaError>;
 
     virtual ~CellInterface() noexcept = default;
 
     virtual std::string GetText() const noexcept = 0;
     virtual Value GetValue() const = 0;
     virtual std::vector<Position> GetReferencedCells() const = 0;
+
+    // the number held natively, which formulas read without parsing the text
+    virtual std::optional<double> GetNumber() const noexcept {
+        return std::nullopt;
+    }
+
+    // non-owning reads, valid until the cell is modified
+    virtual std::string_view GetTextView() const noexcept = 0;
+    virtual ValueView GetValueView() const = 0;
+};
+
+// a reference slot of a formula: the position as written and, while the formula sits in a cell,
+// the cell found there, which evaluation reads without looking the position up
+struct CellReference final {
+    Position pos;
+    const CellInterface* cell = nullptr;
 };
 
 inline constexpr char FORMULA_SIGN = '=';
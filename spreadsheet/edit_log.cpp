@@ -0,0 +1,465 @@
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <system_error>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "cell.h"
+#include "edit_log.h"
+
+namespace {
+    constexpr char FILE_MAGIC[8] = { 'S', 'H', 'E', 'E', 'T', 'L', 'O', 'G' };
+    // the magic followed by the generation
+    constexpr std::size_t HEADER_BYTES = sizeof(FILE_MAGIC) + sizeof(std::uint64_t);
+    // the length and the checksum of the body
+    constexpr std::size_t RECORD_HEADER_BYTES = 2 * sizeof(std::uint32_t);
+    // the kind and the two numbers every record has
+    constexpr std::size_t RECORD_BODY_BYTES = 1 + 2 * sizeof(std::int32_t);
+    // the checkpoint is written out in pieces of about this size
+    constexpr std::size_t CHECKPOINT_PIECE_BYTES = std::size_t(1) << 20;
+
+    using Kind = EditLog::Record::Kind;
+
+    // FNV-1a, enough to tell a torn record from a written one
+    std::uint32_t Checksum(const char* data, std::size_t size) noexcept {
+        std::uint32_t hash = 2166136261u;
+
+        for (std::size_t i = 0; i < size; ++i) {
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+        }
+
+        return hash;
+    }
+
+    template <typename T>
+    void Put(std::vector<char>& bytes, T value) {
+        const char* data = reinterpret_cast<const char*>(&value);
+        bytes.insert(bytes.end(), data, data + sizeof(T));
+    }
+
+    template <typename T>
+    T Get(const char* data) noexcept {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+
+        return value;
+    }
+
+    void EncodeHeader(std::vector<char>& bytes, std::uint64_t generation) {
+        bytes.insert(bytes.end(), std::begin(FILE_MAGIC), std::end(FILE_MAGIC));
+        Put(bytes, generation);
+    }
+
+    void EncodeRecord(std::vector<char>& bytes, Kind kind, int first, int second, const void* payload, std::size_t size) {
+        const std::size_t start = bytes.size();
+        bytes.resize(start + RECORD_HEADER_BYTES);
+
+        bytes.push_back(static_cast<char>(kind));
+        Put<std::int32_t>(bytes, first);
+        Put<std::int32_t>(bytes, second);
+        bytes.insert(bytes.end(), static_cast<const char*>(payload), static_cast<const char*>(payload) + size);
+
+        const std::uint32_t body_size = static_cast<std::uint32_t>(bytes.size() - start - RECORD_HEADER_BYTES);
+        const std::uint32_t checksum = Checksum(bytes.data() + start + RECORD_HEADER_BYTES, body_size);
+        std::memcpy(bytes.data() + start, &body_size, sizeof(body_size));
+        std::memcpy(bytes.data() + start + sizeof(body_size), &checksum, sizeof(checksum));
+    }
+
+    // the generation, or false if the file was never completely started
+    bool DecodeHeader(const std::vector<char>& bytes, std::uint64_t& generation) noexcept {
+        if (bytes.size() < HEADER_BYTES || std::memcmp(bytes.data(), FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+            return false;
+        }
+
+        generation = Get<std::uint64_t>(bytes.data() + sizeof(FILE_MAGIC));
+        return true;
+    }
+
+    // decodes the records following the header, stopping at the first torn or damaged one
+    void DecodeRecords(const std::vector<char>& bytes, std::vector<EditLog::Record>& records) {
+        std::size_t offset = HEADER_BYTES;
+
+        while (bytes.size() - offset >= RECORD_HEADER_BYTES) {
+            const auto body_size = Get<std::uint32_t>(bytes.data() + offset);
+            const auto checksum = Get<std::uint32_t>(bytes.data() + offset + sizeof(body_size));
+            const char* body = bytes.data() + offset + RECORD_HEADER_BYTES;
+
+            if (body_size < RECORD_BODY_BYTES || bytes.size() - offset - RECORD_HEADER_BYTES < body_size
+                || Checksum(body, body_size) != checksum) {
+
+                return;
+            }
+
+            EditLog::Record record;
+            record.kind = static_cast<Kind>(body[0]);
+            const int first = Get<std::int32_t>(body + 1);
+            const int second = Get<std::int32_t>(body + 1 + sizeof(std::int32_t));
+            const char* payload = body + RECORD_BODY_BYTES;
+            const std::size_t payload_size = body_size - RECORD_BODY_BYTES;
+
+            switch (record.kind) {
+            case Kind::Set:
+                record.text.assign(payload, payload_size);
+                break;
+            case Kind::Clear:
+                break;
+            case Kind::SetNumber:
+                if (payload_size != sizeof(double)) {
+                    return;
+                }
+                record.number = Get<double>(payload);
+                break;
+            case Kind::Shift:
+                if (payload_size != 1) {
+                    return;
+                }
+                record.shift = { static_cast<PositionShift::Axis>(payload[0]), first, second };
+                break;
+            default:
+                return;
+            }
+
+            record.pos = { first, second };
+            if (record.kind != Kind::Shift && !record.pos.IsValid()) {
+                return;
+            }
+
+            records.push_back(std::move(record));
+            offset += RECORD_HEADER_BYTES + body_size;
+        }
+    }
+
+    // empty if there is no such file
+    std::vector<char> ReadFile(const std::string& path) {
+        std::ifstream input(path, std::ios::binary);
+
+        return { std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>() };
+    }
+
+    std::string GetCheckpointPath(const std::string& directory) {
+        return directory + "/checkpoint";
+    }
+
+    std::string GetLogPath(const std::string& directory) {
+        return directory + "/edits.log";
+    }
+
+    [[noreturn]] void ThrowSystemError(int error, const char* what) {
+        throw std::system_error(error, std::generic_category(), what);
+    }
+
+#if !defined(_WIN32)
+    // returns the errno of the failure, zero on success
+    int WriteAll(int fd, const std::vector<char>& bytes) noexcept {
+        for (std::size_t written = 0; written < bytes.size();) {
+            const ssize_t result = ::write(fd, bytes.data() + written, bytes.size() - written);
+
+            if (result < 0 && errno != EINTR) {
+                return errno;
+            }
+
+            written += result > 0 ? static_cast<std::size_t>(result) : 0;
+        }
+
+        return 0;
+    }
+
+    int Fsync(int fd) noexcept {
+        while (::fsync(fd) != 0) {
+            if (errno != EINTR) {
+                return errno;
+            }
+        }
+
+        return 0;
+    }
+
+    // makes the files created or renamed in the directory durable
+    int SyncDirectory(const std::string& directory) noexcept {
+        const int fd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+            return errno;
+        }
+
+        const int error = Fsync(fd);
+        ::close(fd);
+
+        return error;
+    }
+#endif
+} // unnamed namespace
+
+#if !defined(_WIN32)
+
+EditLog::EditLog(const std::string& directory, Options options)
+    : directory_(directory)
+    , options_(options) {
+
+    DecodeHeader(ReadFile(GetCheckpointPath(directory_)), generation_);
+
+    const std::string log_path = GetLogPath(directory_);
+    fd_ = ::open(log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (fd_ < 0) {
+        ThrowSystemError(errno, "Cannot open the edit log");
+    }
+
+    // a new log continues the checkpoint
+    if (::lseek(fd_, 0, SEEK_END) == 0) {
+        std::vector<char> header;
+        EncodeHeader(header, generation_);
+
+        if (int error = WriteAll(fd_, header); error != 0 || (error = Fsync(fd_)) != 0
+            || (error = SyncDirectory(directory_)) != 0) {
+
+            ::close(fd_);
+            ThrowSystemError(error, "Cannot start the edit log");
+        }
+    }
+
+    flusher_ = std::thread(&EditLog::RunFlusher, this);
+}
+
+EditLog::~EditLog() noexcept {
+    {
+        std::lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+
+    pending_.notify_one();
+    flusher_.join();
+    ::close(fd_);
+}
+
+void EditLog::Checkpoint(const CellStorage& cells) {
+    // the flusher stays idle afterwards, as edits are only appended by this thread
+    {
+        std::unique_lock lock(mutex_);
+        WaitForFlusher(lock);
+    }
+
+    const std::uint64_t generation = generation_ + 1;
+    const std::string checkpoint_path = GetCheckpointPath(directory_);
+    const std::string temporary_path = checkpoint_path + ".tmp";
+    const int fd = ::open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        ThrowSystemError(errno, "Cannot create the checkpoint");
+    }
+
+    std::vector<char> bytes;
+    EncodeHeader(bytes, generation);
+    int error = 0;
+
+    cells.ForEach([&](Position pos, const Cell& cell) {
+        if (error != 0 || cell.IsPlaceholder()) {
+            return;
+        }
+
+        const std::string_view text = cell.GetTextView();
+        EncodeRecord(bytes, Kind::Set, pos.row, pos.col, text.data(), text.size());
+
+        if (bytes.size() >= CHECKPOINT_PIECE_BYTES) {
+            error = WriteAll(fd, bytes);
+            bytes.clear();
+        }
+    });
+
+    if (error == 0) {
+        error = WriteAll(fd, bytes);
+    }
+    if (error == 0) {
+        error = Fsync(fd);
+    }
+
+    ::close(fd);
+
+    // until renamed, the previous checkpoint and the log stay the durable state
+    if (error != 0 || ::rename(temporary_path.c_str(), checkpoint_path.c_str()) != 0) {
+        const int failure = error != 0 ? error : errno;
+        ::unlink(temporary_path.c_str());
+        ThrowSystemError(failure, "Cannot write the checkpoint");
+    }
+
+    // from here on, the log is ignored until it continues the new checkpoint
+    generation_ = generation;
+    bytes.clear();
+    EncodeHeader(bytes, generation_);
+
+    if ((error = SyncDirectory(directory_)) != 0 || ::ftruncate(fd_, 0) != 0
+        || (error = WriteAll(fd_, bytes)) != 0 || (error = Fsync(fd_)) != 0) {
+
+        std::lock_guard guard(mutex_);
+        error_ = error != 0 ? error : errno;
+        ThrowSystemError(error_, "Cannot restart the edit log");
+    }
+
+    // the checkpoint holds the edits a failed write lost
+    std::lock_guard guard(mutex_);
+    error_ = 0;
+}
+
+void EditLog::RunFlusher() {
+    std::unique_lock lock(mutex_);
+    std::vector<char> writing;
+
+    while (true) {
+        pending_.wait(lock, [this] {
+            return stopping_ || !batch_.empty();
+        });
+
+        if (batch_.empty()) {
+            return;
+        }
+
+        // the edits appended meanwhile join the batch
+        pending_.wait_until(lock, batch_started_ + options_.max_commit_delay, [this] {
+            return stopping_ || sync_requested_ || batch_.size() >= options_.max_batch_bytes;
+        });
+
+        writing.swap(batch_);
+        sync_requested_ = false;
+        const std::uint64_t written = appended_;
+        // past a lost batch, the following edits would be replayed without it
+        const bool failed = error_ != 0;
+        lock.unlock();
+
+        int error = failed ? 0 : WriteAll(fd_, writing);
+        if (!failed && error == 0) {
+            error = Fsync(fd_);
+        }
+
+        writing.clear();
+        lock.lock();
+
+        if (error != 0 && error_ == 0) {
+            error_ = error;
+        }
+
+        flushed_ = written;
+        sync_count_ += failed ? 0 : 1;
+        synced_.notify_all();
+    }
+}
+
+#else
+
+EditLog::EditLog(const std::string& directory, Options options)
+    : directory_(directory)
+    , options_(options) {
+
+    throw std::system_error(std::make_error_code(std::errc::function_not_supported), "Cannot open the edit log");
+}
+
+EditLog::~EditLog() noexcept = default;
+
+void EditLog::Checkpoint(const CellStorage& /* cells */) {
+}
+
+void EditLog::RunFlusher() {
+}
+
+#endif
+
+void EditLog::Append(Record::Kind kind, int first, int second, const void* payload, std::size_t size) noexcept {
+    std::unique_lock lock(mutex_);
+
+    if (error_ != 0) {
+        return;
+    }
+
+    const bool was_empty = batch_.empty();
+    const std::size_t batch_size = batch_.size();
+
+    try {
+        EncodeRecord(batch_, kind, first, second, payload, size);
+    }
+    catch (const std::bad_alloc&) {
+        batch_.resize(batch_size);
+        error_ = ENOMEM;
+        return;
+    }
+
+    ++appended_;
+
+    if (was_empty) {
+        batch_started_ = std::chrono::steady_clock::now();
+    }
+
+    if (was_empty || batch_.size() >= options_.max_batch_bytes) {
+        lock.unlock();
+        pending_.notify_one();
+    }
+}
+
+void EditLog::AppendClear(Position pos) noexcept {
+    Append(Kind::Clear, pos.row, pos.col, nullptr, 0);
+}
+
+void EditLog::AppendNumber(Position pos, double number) noexcept {
+    Append(Kind::SetNumber, pos.row, pos.col, &number, sizeof(number));
+}
+
+void EditLog::AppendSet(Position pos, std::string_view text) noexcept {
+    Append(Kind::Set, pos.row, pos.col, text.data(), text.size());
+}
+
+void EditLog::AppendShift(const PositionShift& shift) noexcept {
+    const char axis = static_cast<char>(shift.axis);
+    Append(Kind::Shift, shift.first, shift.count, &axis, 1);
+}
+
+std::uint64_t EditLog::GetSyncCount() const noexcept {
+    std::lock_guard guard(mutex_);
+    return sync_count_;
+}
+
+std::vector<EditLog::Record> EditLog::ReadBack() const {
+    std::vector<Record> records;
+    std::uint64_t checkpoint_generation = 0;
+    std::uint64_t log_generation = 0;
+
+    if (const std::vector<char> checkpoint = ReadFile(GetCheckpointPath(directory_)); DecodeHeader(checkpoint, checkpoint_generation)) {
+        DecodeRecords(checkpoint, records);
+    }
+
+    // a log left behind by a crash right after a checkpoint holds edits it already has
+    if (const std::vector<char> log = ReadFile(GetLogPath(directory_));
+        DecodeHeader(log, log_generation) && log_generation == checkpoint_generation) {
+
+        DecodeRecords(log, records);
+    }
+
+    return records;
+}
+
+void EditLog::Sync() {
+    std::unique_lock lock(mutex_);
+    WaitForFlusher(lock);
+    ThrowIfFailed();
+}
+
+void EditLog::ThrowIfFailed() const {
+    if (error_ != 0) {
+        ThrowSystemError(error_, "Cannot write the edit log");
+    }
+}
+
+void EditLog::WaitForFlusher(std::unique_lock<std::mutex>& lock) {
+    const std::uint64_t target = appended_;
+
+    if (flushed_ < target) {
+        sync_requested_ = true;
+        pending_.notify_one();
+        synced_.wait(lock, [this, target] {
+            return flushed_ >= target;
+        });
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "common.h"
+
+class CellStorage;
+
+// Write-ahead log of cell edits, kept in a directory next to the last checkpoint of the sheet.
+// Edits are appended to a buffer that a background thread writes out and syncs with one fsync
+// for all of them: as soon as the oldest one has waited for the commit delay, when the buffer
+// fills up, or when asked to. Each record carries its length and a checksum, so that a tail
+// torn by a crash is recognized and dropped when the log is read back.
+// The files are in the byte order of the machine. Supported on POSIX systems only.
+class EditLog final {
+public:
+    struct Options final {
+        // the longest an appended edit waits to be written and synced
+        std::chrono::microseconds max_commit_delay{ 1000 };
+        // larger batches are written without waiting for the delay
+        std::size_t max_batch_bytes = std::size_t(1) << 20;
+    };
+
+    // an edit read back from the checkpoint or the log
+    struct Record final {
+        enum class Kind : std::uint8_t {
+            Set,
+            Clear,
+            SetNumber,
+            Shift,
+        };
+
+        Kind kind = Kind::Set;
+        Position pos;
+        std::string text;
+        double number = 0.0;
+        PositionShift shift;
+    };
+
+    // opens the files in the directory, creating them if needed; appended edits follow the ones
+    // already logged, so the log should be read back and checkpointed first.
+    // Throws std::system_error if a file cannot be opened
+    EditLog(const std::string& directory, Options options);
+    EditLog(const EditLog&) = delete;
+    EditLog& operator=(const EditLog&) = delete;
+    // writes and syncs the edits still pending
+    ~EditLog() noexcept;
+
+    // the appends never fail: once a write failed, or the buffer could not grow, the following
+    // edits are dropped, keeping the log a prefix of the edits, and Sync reports the failure
+    void AppendClear(Position pos) noexcept;
+    // the number must be finite
+    void AppendNumber(Position pos, double number) noexcept;
+    void AppendSet(Position pos, std::string_view text) noexcept;
+    void AppendShift(const PositionShift& shift) noexcept;
+    // replaces the checkpoint with the texts of the cells and empties the log, which logs again
+    // after a failure if it succeeds; throws std::system_error
+    void Checkpoint(const CellStorage& cells);
+    // the fsyncs of the log so far
+    std::uint64_t GetSyncCount() const noexcept;
+    // the records of the checkpoint followed by the ones logged after it, up to the first
+    // torn or damaged one
+    std::vector<Record> ReadBack() const;
+    // returns once the edits appended so far are durable; throws std::system_error
+    // if they could not be written
+    void Sync();
+
+private:
+    void Append(Record::Kind kind, int first, int second, const void* payload, std::size_t size) noexcept;
+    void RunFlusher();
+    void ThrowIfFailed() const;
+    // returns once the flusher is done with the edits appended so far, written or not
+    void WaitForFlusher(std::unique_lock<std::mutex>& lock);
+
+    std::string directory_;
+    Options options_;
+    int fd_ = -1;
+    // of the checkpoint the log continues, the log is ignored if it continues another one
+    std::uint64_t generation_ = 0;
+
+    mutable std::mutex mutex_;
+    std::condition_variable pending_;
+    std::condition_variable synced_;
+    std::vector<char> batch_;
+    std::chrono::steady_clock::time_point batch_started_;
+    // counted in appended records
+    std::uint64_t appended_ = 0;
+    // written and synced, or dropped after a failure
+    std::uint64_t flushed_ = 0;
+    std::uint64_t sync_count_ = 0;
+    bool sync_requested_ = false;
+    bool stopping_ = false;
+    // the errno of the first failed write since the last checkpoint
+    int error_ = 0;
+    std::thread flusher_;
+};
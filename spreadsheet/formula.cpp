@@ -46,6 +46,14 @@ namespace {
             throw FormulaException("Invalid formula.");
         }
 
+        explicit Formula(FormulaAST ast)
+            : ast_(std::move(ast)) {
+        }
+
+        std::unique_ptr<FormulaInterface> Clone(int row_offset, int col_offset) const override {
+            return std::make_unique<Formula>(ast_.Clone(row_offset, col_offset));
+        }
+
         Value Evaluate(const SheetInterface& spreadsheet) const override {
             try {
                 return ast_.Execute(spreadsheet);
@@ -55,6 +63,15 @@ namespace {
             }
         }
 
+        Value Evaluate(const SheetInterface& spreadsheet, Profiler& profiler) const override {
+            try {
+                return ast_.Execute(spreadsheet, profiler);
+            }
+            catch (const FormulaError& exc) {
+                return exc;
+            }
+        }
+
         std::string GetExpression() const override {
             std::stringstream ss;
             ast_.PrintFormula(ss);
@@ -62,12 +79,16 @@ namespace {
             return ss.str();
         }
 
+        const FormulaProgram& GetProgram() const noexcept override {
+            return ast_.GetProgram();
+        }
+
         std::vector<Position> GetReferencedCells() const override {
             std::vector<Position> unique_cells;
             
-            for (auto& cell : ast_.GetCells()) {
-                if (cell.IsValid()) {
-                    unique_cells.push_back(cell);
+            for (const CellReference& reference : ast_.GetCells()) {
+                if (reference.pos.IsValid()) {
+                    unique_cells.push_back(reference.pos);
                 }
             }
 
@@ -77,9 +98,35 @@ namespace {
             return unique_cells;
         }
 
+        const std::forward_list<CellReference>& GetReferences() const noexcept override {
+            return ast_.GetCells();
+        }
+
+        std::forward_list<CellReference>& GetReferences() noexcept override {
+            return ast_.GetCells();
+        }
+
+        bool ShiftReferences(const PositionShift& shift) override {
+            bool reference_deleted = false;
+
+            for (CellReference& reference : ast_.GetCells()) {
+                if (reference.pos.IsValid()) {
+                    reference.pos = shift.Apply(reference.pos);
+
+                    if (!reference.pos.IsValid()) {
+                        reference.cell = nullptr;
+                        reference_deleted = true;
+                    }
+                }
+            }
+
+            return reference_deleted;
+        }
+
     private:
         FormulaAST ast_;
     };
+
 } // unnamed namespace
 
 std::unique_ptr<FormulaInterface> ParseFormula(std::string expression) {
@@ -1,18 +1,71 @@
 #pragma once
 
+#include <cstdint>
+#include <forward_list>
 #include <memory>
 #include <vector>
 
 #include "common.h"
 
+class Profiler;
+
+// A formula flattened into postfix steps over its reference slots, which the most common shapes
+// of formulas are evaluated from by specialized kernels (see FormulaAST).
+struct FormulaProgram final {
+    enum class Op : std::uint8_t {
+        Load,
+        Constant,
+        Add,
+        Subtract,
+        Multiply,
+        Divide,
+        Negate,
+    };
+
+    struct Step final {
+        Op op;
+        // the index into loads or constants
+        std::uint32_t operand = 0;
+    };
+
+    // what is left of a formula without its references, shared by the copies of it
+    struct Code final {
+        std::vector<Step> steps;
+        std::vector<double> constants;
+    };
+
+    std::shared_ptr<const Code> code;
+    // the slot read by each load step
+    std::vector<const CellReference*> loads;
+};
+
 class FormulaInterface {
 public:
     using Value = std::variant<double, FormulaError>;
 
     virtual ~FormulaInterface() noexcept = default;
+    // a copy with the references moved by the offset, as pasting it elsewhere does;
+    // the references leaving the sheet become #REF!
+    virtual std::unique_ptr<FormulaInterface> Clone(int row_offset, int col_offset) const = 0;
     virtual Value Evaluate(const SheetInterface& spreadsheet) const = 0;
+    // counts the evaluation in the profiler as well
+    virtual Value Evaluate(const SheetInterface& spreadsheet, Profiler& profiler) const = 0;
     virtual std::string GetExpression() const = 0;
+    virtual const FormulaProgram& GetProgram() const noexcept = 0;
     virtual std::vector<Position> GetReferencedCells() const = 0;
+    // the reference slots in position order, repeated and deleted references included;
+    // the owning cell binds them to the referenced cells
+    virtual const std::forward_list<CellReference>& GetReferences() const noexcept = 0;
+    virtual std::forward_list<CellReference>& GetReferences() noexcept = 0;
+    // moves the references in place, the deleted ones become #REF! and are unbound;
+    // returns whether any reference was deleted
+    virtual bool ShiftReferences(const PositionShift& shift) = 0;
 };
 
+// whether the code is one operation over two references or numbers, which EvaluateBatch takes
+bool IsBatchable(const FormulaProgram::Code& code) noexcept;
+// evaluates the formulas of a batchable code at once from the numbers their operands read, lane
+// by lane; a result that is not finite stands for the #ARITHM! evaluating the formula gives
+void EvaluateBatch(const FormulaProgram::Code& code, const double* lhs, const double* rhs, std::size_t count,
+    double* results) noexcept;
 std::unique_ptr<FormulaInterface> ParseFormula(std::string expression);
\ No newline at end of file
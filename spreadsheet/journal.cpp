@@ -0,0 +1,101 @@
+#include "cell.h"
+#include "journal.h"
+
+EditJournal::EditJournal() = default;
+EditJournal::~EditJournal() noexcept = default;
+
+void EditJournal::Begin() noexcept {
+    ++depth_;
+}
+
+bool EditJournal::CanRedo() const noexcept {
+    return !redo_.empty();
+}
+
+bool EditJournal::CanUndo() const noexcept {
+    return !undo_.empty();
+}
+
+void EditJournal::Clear() noexcept {
+    undo_.clear();
+    redo_.clear();
+    current_.clear();
+}
+
+void EditJournal::Commit() {
+    if (depth_ == 0 || --depth_ > 0 || current_.empty()) {
+        return;
+    }
+
+    PushUndo(std::move(current_));
+    current_.clear();
+}
+
+std::size_t EditJournal::GetLimit() const noexcept {
+    return limit_;
+}
+
+bool EditJournal::IsInTransaction() const noexcept {
+    return depth_ > 0;
+}
+
+void EditJournal::PushRedo(Transaction transaction) {
+    redo_.push_back(std::move(transaction));
+    Trim(redo_);
+}
+
+void EditJournal::PushUndo(Transaction transaction) {
+    undo_.push_back(std::move(transaction));
+    Trim(undo_);
+}
+
+void EditJournal::Record(Position pos, std::unique_ptr<detail::Impl> contents) {
+    if (limit_ == 0) {
+        return;
+    }
+
+    redo_.clear();
+
+    if (depth_ > 0) {
+        current_.push_back({ pos, std::move(contents) });
+        return;
+    }
+
+    Transaction transaction;
+    transaction.push_back({ pos, std::move(contents) });
+    PushUndo(std::move(transaction));
+}
+
+void EditJournal::SetLimit(std::size_t limit) {
+    limit_ = limit;
+    Trim(undo_);
+    Trim(redo_);
+}
+
+std::optional<EditJournal::Transaction> EditJournal::TakeRedo() {
+    if (redo_.empty()) {
+        return std::nullopt;
+    }
+
+    Transaction transaction = std::move(redo_.back());
+    redo_.pop_back();
+
+    return transaction;
+}
+
+std::optional<EditJournal::Transaction> EditJournal::TakeUndo() {
+    if (undo_.empty()) {
+        return std::nullopt;
+    }
+
+    Transaction transaction = std::move(undo_.back());
+    undo_.pop_back();
+
+    return transaction;
+}
+
+void EditJournal::Trim(std::deque<Transaction>& history) noexcept {
+    while (history.size() > limit_) {
+        history.pop_front();
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "common.h"
+
+namespace detail {
+    class Impl;
+} // namespace detail
+
+// Undo and redo history of cell edits. An edit keeps the replaced contents object itself,
+// parsed formula included, so stepping through the history never reparses; the dependency
+// edges are rebuilt from the references of the restored contents.
+class EditJournal final {
+public:
+    struct Edit final {
+        Position pos;
+        // nullptr for an empty cell
+        std::unique_ptr<detail::Impl> contents;
+    };
+
+    // edits in the order they were made
+    using Transaction = std::vector<Edit>;
+
+    EditJournal();
+    EditJournal(const EditJournal&) = delete;
+    EditJournal& operator=(const EditJournal&) = delete;
+    ~EditJournal() noexcept;
+
+    // nested transactions join the outermost one
+    void Begin() noexcept;
+    bool CanRedo() const noexcept;
+    bool CanUndo() const noexcept;
+    void Clear() noexcept;
+    void Commit();
+    std::size_t GetLimit() const noexcept;
+    bool IsInTransaction() const noexcept;
+    void PushRedo(Transaction transaction);
+    void PushUndo(Transaction transaction);
+    // records the contents replaced by an edit, dropping the redo history
+    void Record(Position pos, std::unique_ptr<detail::Impl> contents);
+    // the number of undoable transactions kept, zero disables the journal
+    void SetLimit(std::size_t limit);
+    std::optional<Transaction> TakeRedo();
+    std::optional<Transaction> TakeUndo();
+
+private:
+    void Trim(std::deque<Transaction>& history) noexcept;
+
+    std::deque<Transaction> undo_;
+    std::deque<Transaction> redo_;
+    Transaction current_;
+    int depth_ = 0;
+    // disabled until asked for, as the kept contents outlive their cells
+    std::size_t limit_ = 0;
+};
@@ -1,7 +1,17 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <limits>
+#include <system_error>
+#include <thread>
 
 #include "common.h"
 #include "formula.h"
+#include "recalculation.h"
+#include "sheet.h"
 #include "test_runner_p.h"
 
 inline std::ostream& operator<<(std::ostream& output, Position pos) {
@@ -58,6 +68,19 @@ namespace {
         ASSERT_EQUAL((Position{ 1, -3 }).ToString(), "");
     }
 
+    void TestPositionToChars() {
+        auto toChars = [](Position pos) {
+            char buffer[Position::MAX_POSITION_LENGTH];
+            return std::string(buffer, pos.ToChars(buffer));
+        };
+
+        ASSERT_EQUAL(toChars(Position{ 0, 0 }), "A1");
+        ASSERT_EQUAL(toChars(Position{ 0, 26 }), "AA1");
+        ASSERT_EQUAL(toChars(Position{ 136, 702 }), "AAA137");
+        ASSERT_EQUAL(toChars(Position{ Position::MAX_ROWS - 1, Position::MAX_COLS - 1 }), "XFD16384");
+        ASSERT_EQUAL(toChars(Position::NONE), "");
+    }
+
     void TestStringToPositionInvalid() {
         ASSERT(!Position::FromString("").IsValid());
         ASSERT(!Position::FromString("A").IsValid());
@@ -123,6 +146,280 @@ namespace {
         ASSERT_EQUAL(std::get<std::string>(cell->GetValue()), "=escaped");
     }
 
+    void TestTextInterning() {
+        auto sheet = CreateSheet();
+        const StringPool& pool = static_cast<Sheet&>(*sheet).GetTextPool();
+
+        sheet->SetCell("A1"_pos, "N/A");
+        sheet->SetCell("B1"_pos, "N/A");
+        sheet->SetCell("C1"_pos, "'N/A");
+        ASSERT_EQUAL(pool.GetSize(), 2u);
+        ASSERT_EQUAL(std::get<std::string>(sheet->GetCell("C1"_pos)->GetValue()), "N/A");
+
+        sheet->SetCell("A1"_pos, "EU");
+        sheet->ClearCell("B1"_pos);
+        ASSERT_EQUAL(pool.GetSize(), 2u);
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), "EU");
+
+        sheet->ClearCell("A1"_pos);
+        sheet->ClearCell("C1"_pos);
+        ASSERT_EQUAL(pool.GetSize(), 0u);
+    }
+
+    void TestSpilledTexts() {
+#if !defined(_WIN32)
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        sheet->SetCell("A1"_pos, "in memory");
+
+        // every text page beyond the chunk being filled is handed back to the disk;
+        // the temporary directory is on tmpfs on many systems, which the spill file refuses
+        try {
+            concrete_sheet.SpillTexts(std::filesystem::temp_directory_path().string(), 0);
+        }
+        catch (const std::system_error&) {
+            concrete_sheet.SpillTexts(std::filesystem::current_path().string(), 0);
+        }
+
+#if defined(__linux__)
+        if (std::filesystem::is_directory("/dev/shm")) {
+            bool rejected = false;
+
+            try {
+                static_cast<Sheet&>(*CreateSheet()).SpillTexts("/dev/shm", 0);
+            }
+            catch (const std::system_error&) {
+                rejected = true;
+            }
+
+            ASSERT(rejected);
+        }
+#endif
+
+        auto text_at = [](int row) {
+            return "'row " + std::to_string(row) + std::string(100, '.');
+        };
+
+        for (int row = 1; row < 16000; ++row) {
+            sheet->SetCell({ row, 0 }, text_at(row));
+        }
+
+        sheet->SetCell("B1"_pos, text_at(1));
+        sheet->SetCell("B2"_pos, "=A3");
+        const std::size_t spilled = concrete_sheet.GetMemoryStats().spilled_text_bytes;
+        ASSERT(spilled >= 15999 * 100);
+        ASSERT(concrete_sheet.GetMemoryStats().resident_spilled_text_bytes <= (std::size_t(1) << 20));
+
+        for (int row = 1; row < 16000; ++row) {
+            ASSERT_EQUAL(sheet->GetCell({ row, 0 })->GetText(), text_at(row));
+        }
+
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), "in memory");
+        ASSERT_EQUAL(std::get<std::string_view>(sheet->GetCell("B1"_pos)->GetValueView()), text_at(1).substr(1));
+        ASSERT_EQUAL(sheet->GetCell("B2"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Value));
+
+        // the shared text is released with its last cell, the freed blocks are reused
+        for (int row = 1; row < 8000; ++row) {
+            sheet->ClearCell({ row, 0 });
+        }
+
+        ASSERT(concrete_sheet.GetMemoryStats().spilled_text_bytes < spilled);
+        ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetText(), text_at(1));
+
+        for (int row = 1; row < 8000; ++row) {
+            sheet->SetCell({ row, 0 }, text_at(row));
+        }
+
+        ASSERT_EQUAL(concrete_sheet.GetMemoryStats().spilled_text_bytes, spilled);
+        ASSERT(concrete_sheet.GetMemoryStats().resident_spilled_text_bytes <= (std::size_t(1) << 20));
+        ASSERT_EQUAL(sheet->GetCell({ 7999, 0 })->GetText(), text_at(7999));
+
+        // the spilled texts stay where they are
+        bool caught = false;
+
+        try {
+            concrete_sheet.SpillTexts(std::filesystem::current_path().string(), 0);
+        }
+        catch (const std::logic_error&) {
+            caught = true;
+        }
+
+        ASSERT(caught);
+        ASSERT_EQUAL(sheet->GetCell({ 15999, 0 })->GetText(), text_at(15999));
+        sheet->SetCell("C1"_pos, text_at(2));
+        ASSERT_EQUAL(concrete_sheet.GetMemoryStats().spilled_text_bytes, spilled);
+#endif
+    }
+
+    void TestEditLogRecovery() {
+#if !defined(_WIN32)
+        const std::filesystem::path directory = std::filesystem::temp_directory_path()
+            / ("spreadsheet-log-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+        std::filesystem::create_directories(directory);
+
+        auto texts_of = [](const SheetInterface& sheet) {
+            std::ostringstream output;
+            sheet.PrintTexts(output);
+            return output.str();
+        };
+
+        std::string expected;
+        {
+            auto sheet = CreateSheet();
+            Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+            concrete_sheet.OpenLog(directory.string());
+            concrete_sheet.SetUndoLimit(10);
+
+            sheet->SetCell("A1"_pos, "1");
+            concrete_sheet.SetNumber("A2"_pos, 2.5);
+            sheet->SetCell("B1"_pos, "=A1+A2");
+            sheet->SetCell("C1"_pos, "'=text");
+            concrete_sheet.FillDown("B1"_pos, { 3, 1 });
+            concrete_sheet.Checkpoint();
+
+            sheet->SetCell("D1"_pos, "gone");
+            sheet->ClearCell("D1"_pos);
+            concrete_sheet.CopyRange("A1"_pos, { 2, 2 }, "E5"_pos);
+            concrete_sheet.InsertRows(0);
+            sheet->SetCell("A1"_pos, "=B2*2");
+            sheet->SetCell("A1"_pos, "=B2*3");
+            concrete_sheet.Undo();
+            concrete_sheet.SyncLog();
+
+            expected = texts_of(*sheet);
+        }
+
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        auto is_misuse = [](auto action) {
+            try {
+                action();
+            }
+            catch (const std::logic_error&) {
+                return true;
+            }
+            return false;
+        };
+
+        ASSERT(is_misuse([&] { concrete_sheet.SyncLog(); }));
+        ASSERT(is_misuse([&] { concrete_sheet.Checkpoint(); }));
+        concrete_sheet.OpenLog(directory.string());
+        ASSERT(is_misuse([&] { concrete_sheet.OpenLog(directory.string()); }));
+        {
+            auto filled_sheet = CreateSheet();
+            filled_sheet->SetCell("A1"_pos, "1");
+            ASSERT(is_misuse([&] { static_cast<Sheet&>(*filled_sheet).OpenLog(directory.string()); }));
+        }
+        ASSERT_EQUAL(texts_of(*sheet), expected);
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetValue(), CellInterface::Value(7.0));
+        ASSERT_EQUAL(sheet->GetCell("F6"_pos)->GetValue(), CellInterface::Value(3.5));
+        ASSERT(!concrete_sheet.CanUndo());
+
+        concrete_sheet.SetNumber("A2"_pos, 4);
+        concrete_sheet.SyncLog();
+        expected = texts_of(*sheet);
+        sheet.reset();
+
+        // a record torn by a crash is dropped along with whatever follows it
+        {
+            std::ofstream log(directory / "edits.log", std::ios::binary | std::ios::app);
+            const char torn[] = { 40, 0, 0, 0, 1, 2, 3, 4, 0, 1 };
+            log.write(torn, sizeof(torn));
+        }
+
+        sheet = CreateSheet();
+        static_cast<Sheet&>(*sheet).OpenLog(directory.string());
+        ASSERT_EQUAL(texts_of(*sheet), expected);
+        sheet->SetCell("A3"_pos, "after");
+        sheet.reset();
+
+        sheet = CreateSheet();
+        static_cast<Sheet&>(*sheet).OpenLog(directory.string());
+        ASSERT_EQUAL(sheet->GetCell("A3"_pos)->GetText(), "after");
+        sheet.reset();
+
+        std::filesystem::remove_all(directory);
+#endif
+    }
+
+    void TestEditLogLostReferences() {
+#if !defined(_WIN32)
+        const std::filesystem::path directory = std::filesystem::temp_directory_path()
+            / ("spreadsheet-log-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+        std::filesystem::create_directories(directory);
+
+        auto texts_of = [](const SheetInterface& sheet) {
+            std::ostringstream output;
+            sheet.PrintTexts(output);
+            return output.str();
+        };
+
+        std::string expected;
+        {
+            auto sheet = CreateSheet();
+            Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+            concrete_sheet.OpenLog(directory.string());
+
+            sheet->SetCell("A1"_pos, "1");
+            sheet->SetCell("B2"_pos, "=A1*2");
+            sheet->SetCell("C3"_pos, "=A2+1");
+            // one reference lost by a copy, one by a delete, one typed in
+            concrete_sheet.CopyRange("B2"_pos, { 1, 1 }, "B1"_pos);
+            concrete_sheet.DeleteRows(1);
+            sheet->SetCell("D1"_pos, "=-#REF!");
+            concrete_sheet.SyncLog();
+
+            ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetText(), "=#REF!*2");
+            ASSERT_EQUAL(sheet->GetCell("C2"_pos)->GetText(), "=#REF!+1");
+            ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetText(), "=-#REF!");
+            expected = texts_of(*sheet);
+        }
+
+        // the second open replays the checkpoint the first one wrote
+        for (int open = 0; open < 2; ++open) {
+            auto sheet = CreateSheet();
+            static_cast<Sheet&>(*sheet).OpenLog(directory.string());
+            ASSERT_EQUAL(texts_of(*sheet), expected);
+
+            for (Position pos : { "B1"_pos, "C2"_pos, "D1"_pos }) {
+                ASSERT_EQUAL(sheet->GetCell(pos)->GetValue(), CellInterface::Value(FormulaError(FormulaError::Category::Ref)));
+            }
+        }
+
+        std::filesystem::remove_all(directory);
+#endif
+    }
+
+    void TestEditLogGroupCommit() {
+#if !defined(_WIN32)
+        const std::filesystem::path directory = std::filesystem::temp_directory_path()
+            / ("spreadsheet-log-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+        std::filesystem::create_directories(directory);
+
+        {
+            EditLog::Options options;
+            options.max_commit_delay = std::chrono::milliseconds(200);
+            EditLog log(directory.string(), options);
+
+            for (int row = 0; row < 1000; ++row) {
+                log.AppendNumber({ row, 0 }, row);
+            }
+
+            // the edits appended within the delay share the fsyncs
+            log.Sync();
+            ASSERT(log.GetSyncCount() <= 10);
+
+            const std::vector<EditLog::Record> records = log.ReadBack();
+            ASSERT_EQUAL(records.size(), 1000u);
+            ASSERT(records[999].kind == EditLog::Record::Kind::SetNumber);
+            ASSERT_EQUAL(records[999].pos, (Position{ 999, 0 }));
+            ASSERT_EQUAL(records[999].number, 999.0);
+        }
+
+        std::filesystem::remove_all(directory);
+#endif
+    }
+
     void TestClearCell() {
         auto sheet = CreateSheet();
 
@@ -134,6 +431,140 @@ namespace {
         sheet->ClearCell("J10"_pos);
     }
 
+    void TestCellStorageDensity() {
+        auto sheet = CreateSheet();
+        auto texts = [&] {
+            std::ostringstream output;
+            sheet->PrintTexts(output);
+            return output.str();
+        };
+
+        sheet->SetCell("A1"_pos, "sparse");
+        sheet->SetCell("ZZ1"_pos, "note");
+        for (int col = 0; col < 20; ++col) {
+            sheet->SetCell({ 1, col + 5 }, std::to_string(col));
+        }
+
+        const CellStorage& storage = static_cast<Sheet&>(*sheet).GetStorage();
+
+        ASSERT(!storage.IsRowDense(0));
+        ASSERT(storage.IsRowDense(1));
+        ASSERT_EQUAL(storage.GetCellCount(), 22u);
+        ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{ 2, 702 }));
+        ASSERT_EQUAL(sheet->GetCell({ 1, 4 }), nullptr);
+        ASSERT_EQUAL(sheet->GetCell({ 1, 24 })->GetText(), "19");
+
+        sheet->SetCell({ 1, 2 }, "grown");
+        ASSERT(storage.IsRowDense(1));
+        ASSERT_EQUAL(sheet->GetCell({ 1, 2 })->GetText(), "grown");
+
+        sheet->SetCell({ 1, 700 }, "far");
+        ASSERT(!storage.IsRowDense(1));
+        ASSERT_EQUAL(sheet->GetCell({ 1, 700 })->GetText(), "far");
+        sheet->ClearCell({ 1, 700 });
+        ASSERT(storage.IsRowDense(1));
+
+        for (int col = 0; col < 15; ++col) {
+            sheet->ClearCell({ 1, col + 5 });
+        }
+
+        ASSERT(!storage.IsRowDense(1));
+        ASSERT_EQUAL(sheet->GetCell({ 1, 20 })->GetText(), "15");
+        ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{ 2, 702 }));
+
+        sheet->ClearCell("ZZ1"_pos);
+        ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{ 2, 25 }));
+        ASSERT_EQUAL(texts(), "sparse" + std::string(24, '\t') + "\n\t\tgrown" + std::string(18, '\t')
+            + "15\t16\t17\t18\t19\n");
+    }
+
+    void TestPlaceholderCells() {
+        auto sheet = CreateSheet();
+        Sheet& owner = static_cast<Sheet&>(*sheet);
+
+        sheet->SetCell("A1"_pos, "=B1+C1");
+        ASSERT_EQUAL(owner.GetMemoryStats().placeholders, 2u);
+
+        sheet->SetCell("A1"_pos, "=C1+D1");
+        ASSERT(sheet->GetCell("B1"_pos) == nullptr);
+        ASSERT(sheet->GetCell("C1"_pos) != nullptr);
+        ASSERT_EQUAL(owner.GetMemoryStats().placeholders, 2u);
+
+        sheet->SetCell("C1"_pos, "3");
+        sheet->SetCell("A2"_pos, "=A1");
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(), CellInterface::Value(3.0));
+
+        sheet->ClearCell("C1"_pos);
+        ASSERT(sheet->GetCell("C1"_pos) != nullptr);
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(), CellInterface::Value(0.0));
+
+        sheet->ClearCell("A1"_pos);
+        ASSERT(sheet->GetCell("C1"_pos) == nullptr);
+        ASSERT(sheet->GetCell("D1"_pos) == nullptr);
+        ASSERT(sheet->GetCell("A1"_pos) != nullptr);
+
+        sheet->ClearCell("A2"_pos);
+        ASSERT(sheet->GetCell("A1"_pos) == nullptr);
+        ASSERT_EQUAL(owner.GetMemoryStats().cells, 0u);
+
+        sheet->SetCell("E5"_pos, "");
+        sheet->SetCell("E6"_pos, "=E5");
+        sheet->SetCell("E6"_pos, "1");
+        ASSERT(sheet->GetCell("E5"_pos) != nullptr);
+    }
+
+    void TestMemoryStatsCountFormulas() {
+        auto sheet = CreateSheet();
+        Sheet& owner = static_cast<Sheet&>(*sheet);
+
+        sheet->SetCell("A1"_pos, "1");
+        sheet->SetCell("B1"_pos, "=A1+A2");
+        sheet->SetCell("B2"_pos, "=B1*2");
+        ASSERT_EQUAL(owner.GetMemoryStats().formulas, 2u);
+        ASSERT_EQUAL(owner.GetMemoryStats().placeholders, 1u);
+
+        sheet->SetCell("B2"_pos, "text");
+        sheet->ClearCell("B1"_pos);
+        ASSERT_EQUAL(owner.GetMemoryStats().formulas, 0u);
+        ASSERT_EQUAL(owner.GetMemoryStats().placeholders, 0u);
+    }
+
+    void TestMemorySteadyUnderChurn() {
+        auto sheet = CreateSheet();
+        Sheet& owner = static_cast<Sheet&>(*sheet);
+        sheet->SetCell("A1"_pos, "anchor");
+
+        auto churn = [&] {
+            for (int row = 0; row < 200; ++row) {
+                for (int col = 0; col < 30; ++col) {
+                    sheet->SetCell({ row, col + 1 }, "=" + Position{ row + 300, col }.ToString() + "+1");
+                    sheet->SetCell({ row + 300, col }, "label " + std::to_string(col));
+                }
+            }
+
+            for (int row = 0; row < 200; ++row) {
+                for (int col = 0; col < 30; ++col) {
+                    sheet->ClearCell({ row + 300, col });
+                    sheet->ClearCell({ row, col + 1 });
+                }
+            }
+
+            owner.Compact();
+        };
+
+        churn();
+        const MemoryStats settled = owner.GetMemoryStats();
+        churn();
+        const MemoryStats after = owner.GetMemoryStats();
+
+        ASSERT_EQUAL(after.cells, 1u);
+        ASSERT_EQUAL(after.placeholders, 0u);
+        ASSERT_EQUAL(after.allocated_rows, 1u);
+        ASSERT_EQUAL(after.interned_texts, 1u);
+        ASSERT_EQUAL(after.storage_bytes, settled.storage_bytes);
+        ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{ 1, 1 }));
+    }
+
     void TestFormulaArithmetic() {
         auto sheet = CreateSheet();
         auto evaluate = [&](std::string expr) {
@@ -205,6 +636,33 @@ namespace {
             CellInterface::Value(FormulaError::Category::Value));
     }
 
+    void TestReadViews() {
+        auto sheet = CreateSheet();
+        sheet->SetCell("A1"_pos, "'=escaped");
+        sheet->SetCell("A2"_pos, "'");
+        sheet->SetCell("A3"_pos, "=1/0");
+        sheet->SetCell("A4"_pos, "=(1+2)*A5");
+        sheet->SetCell("A5"_pos, " +2.5e1");
+
+        const CellInterface* a1 = sheet->GetCell("A1"_pos);
+        ASSERT_EQUAL(a1->GetTextView(), "'=escaped");
+        ASSERT_EQUAL(std::get<std::string_view>(a1->GetValueView()), "=escaped");
+        ASSERT_EQUAL(std::get<std::string_view>(sheet->GetCell("A2"_pos)->GetValueView()), "");
+        ASSERT_EQUAL(std::get<FormulaError>(sheet->GetCell("A3"_pos)->GetValueView()),
+            FormulaError(FormulaError::Category::Arithmetic));
+        ASSERT_EQUAL(sheet->GetCell("A4"_pos)->GetTextView(), "=(1+2)*A5");
+        ASSERT_EQUAL(std::get<double>(sheet->GetCell("A4"_pos)->GetValueView()), 75.0);
+
+        for (const char* text : { "inf", "-nan", "+-1", "1 ", "0x10", "1e" }) {
+            sheet->SetCell("A5"_pos, text);
+            ASSERT_EQUAL(sheet->GetCell("A4"_pos)->GetValue(),
+                CellInterface::Value(FormulaError::Category::Value));
+        }
+
+        sheet->SetCell("A5"_pos, "-.5");
+        ASSERT_EQUAL(sheet->GetCell("A4"_pos)->GetValue(), CellInterface::Value(-1.5));
+    }
+
     void TestErrorArithmetic() {
         auto sheet = CreateSheet();
 
@@ -247,6 +705,34 @@ namespace {
         }
     }
 
+    void TestFormulaKernels() {
+        auto sheet = CreateSheet();
+        const char* inputs[] = { "", "3", "0", "-2.5", "abc", " 4", "=1/0", "1e308" };
+        // the shapes with kernels against the same formulas left to the tree by one more operation
+        const char* shapes[] = { "A1", "-A1", "2", "-2", "A1+B1", "A1-B1", "A1*B1", "A1/B1",
+            "A1+2", "2-A1", "A1*1e308", "A1/2", "2/A1", "2*3" };
+
+        for (const char* lhs : inputs) {
+            for (const char* rhs : inputs) {
+                sheet->ClearCell("A1"_pos);
+                sheet->ClearCell("B1"_pos);
+                sheet->SetCell("A1"_pos, lhs);
+                sheet->SetCell("B1"_pos, rhs);
+
+                for (int row = 0; row < static_cast<int>(std::size(shapes)); ++row) {
+                    sheet->SetCell({ row + 1, 2 }, std::string("=") + shapes[row]);
+                    sheet->SetCell({ row + 1, 3 }, std::string("=(") + shapes[row] + ")*1");
+
+                    ASSERT(sheet->GetCell({ row + 1, 2 })->GetValue() == sheet->GetCell({ row + 1, 3 })->GetValue());
+                }
+            }
+        }
+
+        sheet->SetCell("A2"_pos, "=A1+B1");
+        static_cast<Sheet&>(*sheet).DeleteRows(0);
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Ref));
+    }
+
     void TestEmptyCellTreatedAsZero() {
         auto sheet = CreateSheet();
         sheet->SetCell("A1"_pos, "=B2");
@@ -348,27 +834,1096 @@ namespace {
         ASSERT(caught);
         ASSERT_EQUAL(sheet->GetCell("M6"_pos)->GetText(), "Ready");
     }
+
+    void TestInsertDeleteRows() {
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        sheet->SetCell("A1"_pos, "1");
+        sheet->SetCell("A2"_pos, "=A1+A3");
+        sheet->SetCell("A3"_pos, "2");
+        sheet->SetCell("B3"_pos, "=A2*2");
+
+        concrete_sheet.InsertRows(1, 2);
+        ASSERT(sheet->GetCell("A2"_pos) == nullptr);
+        ASSERT_EQUAL(sheet->GetCell("A4"_pos)->GetText(), "=A1+A5");
+        ASSERT_EQUAL(sheet->GetCell("B5"_pos)->GetText(), "=A4*2");
+        ASSERT_EQUAL(sheet->GetCell("B5"_pos)->GetValue(), CellInterface::Value(6.0));
+        ASSERT_EQUAL(static_cast<Cell*>(sheet->GetCell("A4"_pos))->GetPosition(), "A4"_pos);
+
+        sheet->SetCell("A5"_pos, "3");
+        ASSERT_EQUAL(sheet->GetCell("B5"_pos)->GetValue(), CellInterface::Value(8.0));
+
+        concrete_sheet.DeleteRows(0);
+        ASSERT_EQUAL(sheet->GetCell("A3"_pos)->GetText(), "=#REF!+A4");
+        ASSERT_EQUAL(sheet->GetCell("A3"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Ref));
+        ASSERT_EQUAL(sheet->GetCell("B4"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Value));
+        ASSERT_EQUAL(sheet->GetCell("A3"_pos)->GetReferencedCells(), std::vector<Position>{ "A4"_pos });
+
+        // the placeholder of a deleted reference goes away with its last dependent
+        sheet->SetCell("C1"_pos, "=D7");
+        concrete_sheet.DeleteRows(0);
+        ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{ 3, 2 }));
+        ASSERT(sheet->GetCell("D6"_pos) == nullptr);
+        ASSERT_EQUAL(concrete_sheet.GetMemoryStats().cells, 3u);
+
+        concrete_sheet.DeleteRows(0, 2);
+        ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetText(), "=#REF!*2");
+        sheet->SetCell("B1"_pos, "=A1");
+        ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(), CellInterface::Value(3.0));
+
+        sheet->SetCell("A16384"_pos, "end");
+        try {
+            concrete_sheet.InsertRows(0);
+            ASSERT(false);
+        }
+        catch (const InvalidPositionException&) {
+            // cells can't be pushed out of the sheet
+        }
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), "3");
+    }
+
+    void TestInsertDeleteCols() {
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+
+        for (int col = 0; col < 32; ++col) {
+            sheet->SetCell({ 0, col }, std::to_string(col));
+        }
+        sheet->SetCell("A2"_pos, "=C1+Z1+AF1");
+        ASSERT(concrete_sheet.GetStorage().IsRowDense(0));
+
+        concrete_sheet.InsertCols(2, 3);
+        ASSERT(concrete_sheet.GetStorage().IsRowDense(0));
+        ASSERT(sheet->GetCell("C1"_pos) == nullptr);
+        ASSERT_EQUAL(sheet->GetCell("F1"_pos)->GetText(), "2");
+        ASSERT_EQUAL(sheet->GetCell("AI1"_pos)->GetText(), "31");
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetText(), "=F1+AC1+AI1");
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(), CellInterface::Value(58.0));
+
+        concrete_sheet.DeleteCols(1, 26);
+        ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{ 2, 9 }));
+        ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetText(), "24");
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetText(), "=#REF!+C1+I1");
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Ref));
+        ASSERT_EQUAL(concrete_sheet.GetMemoryStats().cells, 10u);
+
+        concrete_sheet.DeleteCols(0);
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), "24");
+        ASSERT(sheet->GetCell("A2"_pos) == nullptr);
+        ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{ 1, 8 }));
+    }
+
+    void TestInvalidShiftCounts() {
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        concrete_sheet.SetUndoLimit(10);
+        sheet->SetCell("B2"_pos, "1");
+        sheet->SetCell("C3"_pos, "=B2");
+
+        const std::function<void(Sheet&, int, int)> shifts[] = {
+            &Sheet::InsertRows, &Sheet::InsertCols, &Sheet::DeleteRows, &Sheet::DeleteCols,
+        };
+
+        for (const auto& shift : shifts) {
+            for (int count : { 0, -2 }) {
+                bool caught = false;
+
+                try {
+                    shift(concrete_sheet, 1, count);
+                }
+                catch (const InvalidPositionException&) {
+                    caught = true;
+                }
+
+                ASSERT(caught);
+            }
+        }
+
+        // nothing moved, and the history is kept
+        ASSERT_EQUAL(sheet->GetCell("C3"_pos)->GetText(), "=B2");
+        ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{ 3, 3 }));
+        ASSERT(concrete_sheet.CanUndo());
+    }
+
+    void TestCopyRange() {
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        sheet->SetCell("A1"_pos, "1");
+        sheet->SetCell("A2"_pos, "2");
+        sheet->SetCell("B1"_pos, "=A1*10");
+        sheet->SetCell("B2"_pos, "'text");
+        sheet->SetCell("D5"_pos, "old");
+        sheet->SetCell("F1"_pos, "=D5");
+
+        concrete_sheet.CopyRange("A1"_pos, { 2, 3 }, "C4"_pos);
+        ASSERT_EQUAL(sheet->GetCell("C4"_pos)->GetText(), "1");
+        ASSERT_EQUAL(sheet->GetCell("D4"_pos)->GetText(), "=C4*10");
+        ASSERT_EQUAL(sheet->GetCell("D4"_pos)->GetValue(), CellInterface::Value(10.0));
+        ASSERT_EQUAL(sheet->GetCell("D5"_pos)->GetText(), "'text");
+        ASSERT_EQUAL(sheet->GetCell("F1"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Value));
+        ASSERT(sheet->GetCell("E4"_pos) == nullptr);
+
+        // references moved out of the sheet, and overlapping blocks
+        concrete_sheet.CopyRange("B1"_pos, { 1, 1 }, "A1"_pos);
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), "=#REF!*10");
+        concrete_sheet.CopyRange("C4"_pos, { 2, 2 }, "D4"_pos);
+        ASSERT_EQUAL(sheet->GetCell("D4"_pos)->GetText(), "1");
+        ASSERT_EQUAL(sheet->GetCell("E4"_pos)->GetText(), "=D4*10");
+        ASSERT_EQUAL(sheet->GetCell("D5"_pos)->GetText(), "2");
+        ASSERT_EQUAL(sheet->GetCell("E5"_pos)->GetText(), "'text");
+        ASSERT_EQUAL(sheet->GetCell("F1"_pos)->GetValue(), CellInterface::Value(2.0));
+
+        // empty source cells clear the destination
+        concrete_sheet.CopyRange("Z1"_pos, { 1, 1 }, "D5"_pos);
+        ASSERT(sheet->GetCell("D5"_pos)->GetText().empty());
+        ASSERT_EQUAL(sheet->GetCell("F1"_pos)->GetValue(), CellInterface::Value(0.0));
+
+        sheet->SetCell("H1"_pos, "=H2");
+        sheet->SetCell("H3"_pos, "=H2");
+        try {
+            concrete_sheet.CopyRange("H1"_pos, { 1, 1 }, "H2"_pos);
+            ASSERT(false);
+        }
+        catch (const CircularDependencyException&) {
+            // H2 would become =H3, the sheet is left as it was
+        }
+        ASSERT(sheet->GetCell("H2"_pos)->GetText().empty());
+
+        try {
+            concrete_sheet.CopyRange("A1"_pos, { 2, 2 }, "XFD1"_pos);
+            ASSERT(false);
+        }
+        catch (const InvalidPositionException&) {
+        }
+    }
+
+    void TestFillDown() {
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        sheet->SetCell("A1"_pos, "1");
+        sheet->SetCell("A2"_pos, "=A1+1");
+        sheet->SetCell("B2"_pos, "=A2*B1");
+        sheet->SetCell("B1"_pos, "1");
+        sheet->SetCell("C2"_pos, "=B4");
+
+        concrete_sheet.FillDown("A2"_pos, { 100, 2 });
+        ASSERT_EQUAL(sheet->GetCell("A100"_pos)->GetText(), "=A99+1");
+        ASSERT_EQUAL(sheet->GetCell("A101"_pos)->GetValue(), CellInterface::Value(101.0));
+        ASSERT_EQUAL(sheet->GetCell("B6"_pos)->GetValue(), CellInterface::Value(720.0));
+        ASSERT_EQUAL(sheet->GetCell("C2"_pos)->GetValue(), CellInterface::Value(24.0));
+
+        sheet->SetCell("A1"_pos, "0");
+        ASSERT_EQUAL(sheet->GetCell("A101"_pos)->GetValue(), CellInterface::Value(100.0));
+        ASSERT_EQUAL(sheet->GetCell("C2"_pos)->GetValue(), CellInterface::Value(6.0));
+
+        sheet->SetCell("E5"_pos, "=F3");
+        sheet->SetCell("F2"_pos, "=E4");
+        try {
+            concrete_sheet.FillDown("F2"_pos, { 2, 1 });
+            ASSERT(false);
+        }
+        catch (const CircularDependencyException&) {
+            // F3 would become =E5
+        }
+        ASSERT(sheet->GetCell("F3"_pos)->GetText().empty());
+    }
+
+    void TestUndoRedo() {
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        concrete_sheet.SetUndoLimit(100);
+        ASSERT(!concrete_sheet.Undo());
+
+        sheet->SetCell("A1"_pos, "1");
+        sheet->SetCell("A2"_pos, "=A1+B1");
+        sheet->SetCell("A1"_pos, "2");
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(), CellInterface::Value(2.0));
+        const SheetStats before_undo = concrete_sheet.GetStats();
+
+        ASSERT(concrete_sheet.Undo());
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), "1");
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(), CellInterface::Value(1.0));
+
+        ASSERT(concrete_sheet.Undo());
+        ASSERT(sheet->GetCell("A2"_pos) == nullptr);
+        ASSERT(sheet->GetCell("B1"_pos) == nullptr);
+
+        ASSERT(concrete_sheet.Redo());
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetText(), "=A1+B1");
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(), CellInterface::Value(1.0));
+        ASSERT(sheet->GetCell("B1"_pos) != nullptr);
+        // the formula object came back from the journal
+        ASSERT_EQUAL(concrete_sheet.GetStats().parses, before_undo.parses);
+
+        sheet->ClearCell("A1"_pos);
+        ASSERT(!concrete_sheet.CanRedo());
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(), CellInterface::Value(0.0));
+        ASSERT(concrete_sheet.Undo());
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(), CellInterface::Value(1.0));
+
+        // a transaction and a paste are undone as a whole
+        concrete_sheet.BeginTransaction();
+        sheet->SetCell("B1"_pos, "10");
+
+        // the history stays put while a transaction is open
+        for (bool undo : { true, false }) {
+            bool caught = false;
+
+            try {
+                undo ? concrete_sheet.Undo() : concrete_sheet.Redo();
+            }
+            catch (const std::logic_error&) {
+                caught = true;
+            }
+
+            ASSERT(caught);
+        }
+
+        sheet->SetCell("A1"_pos, "=B1*2");
+        concrete_sheet.CommitTransaction();
+        concrete_sheet.FillDown("A1"_pos, { 3, 2 });
+        ASSERT_EQUAL(sheet->GetCell("A3"_pos)->GetText(), "=B3*2");
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(), CellInterface::Value(20.0));
+
+        ASSERT(concrete_sheet.Undo());
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetText(), "=A1+B1");
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(), CellInterface::Value(30.0));
+        ASSERT(sheet->GetCell("A3"_pos) == nullptr);
+        ASSERT(concrete_sheet.Undo());
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), "1");
+        ASSERT(sheet->GetCell("B1"_pos)->GetText().empty());
+        ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(), CellInterface::Value(1.0));
+
+        ASSERT(concrete_sheet.Redo());
+        ASSERT(concrete_sheet.Redo());
+        ASSERT_EQUAL(sheet->GetCell("A3"_pos)->GetValue(), CellInterface::Value(20.0));
+        ASSERT(!concrete_sheet.Redo());
+
+        concrete_sheet.InsertRows(0);
+        ASSERT(!concrete_sheet.CanUndo());
+
+        concrete_sheet.SetUndoLimit(2);
+        for (int i = 0; i < 5; ++i) {
+            sheet->SetCell("C1"_pos, std::to_string(i));
+        }
+        ASSERT(concrete_sheet.Undo());
+        ASSERT(concrete_sheet.Undo());
+        ASSERT(!concrete_sheet.Undo());
+        ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetText(), "2");
+    }
+
+    void TestChangeSubscription() {
+        using Batches = std::vector<std::vector<Position>>;
+
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        Batches changed;
+        Batches pending;
+        const auto id = concrete_sheet.Subscribe([&](const ChangeTracker::Changes& changes) {
+            changed.push_back(changes.changed);
+            pending.push_back(changes.pending);
+        });
+        const auto read = [&sheet](std::initializer_list<Position> positions) {
+            for (Position pos : positions) {
+                sheet->GetCell(pos)->GetValue();
+            }
+        };
+        const auto clear = [&] {
+            changed.clear();
+            pending.clear();
+        };
+
+        // the new formulas are reported pending without being evaluated
+        sheet->SetCell("A1"_pos, "1");
+        sheet->SetCell("B1"_pos, "=A1*0");
+        sheet->SetCell("C1"_pos, "=A1+1");
+        ASSERT_EQUAL(changed, (Batches{ { "A1"_pos }, {}, {} }));
+        ASSERT_EQUAL(pending, (Batches{ {}, { "B1"_pos }, { "C1"_pos } }));
+        ASSERT(!static_cast<const Cell*>(sheet->GetCell("C1"_pos))->GetFormula()->IsCurrent());
+
+        read({ "B1"_pos, "C1"_pos });
+        clear();
+        sheet->SetCell("A1"_pos, "2");
+        ASSERT_EQUAL(changed, (Batches{ { "A1"_pos } }));
+        ASSERT_EQUAL(pending, (Batches{ { "B1"_pos, "C1"_pos } }));
+        ASSERT(!static_cast<const Cell*>(sheet->GetCell("C1"_pos))->GetFormula()->IsCurrent());
+
+        // the formulas still pending are not reported again
+        clear();
+        sheet->SetCell("A1"_pos, "2");
+        sheet->SetCell("C1"_pos, "=A1+1");
+        sheet->SetCell("A1"_pos, "3");
+        ASSERT_EQUAL(changed, (Batches{ { "A1"_pos } }));
+        ASSERT_EQUAL(pending, (Batches{ {} }));
+
+        // evaluated during the transaction, B1 stays zero whatever A1 holds
+        clear();
+        concrete_sheet.BeginTransaction();
+        sheet->SetCell("A1"_pos, "5");
+        sheet->SetCell("D2"_pos, "text");
+        sheet->ClearCell("D2"_pos);
+        read({ "B1"_pos, "C1"_pos });
+        concrete_sheet.CommitTransaction();
+        ASSERT_EQUAL(changed, (Batches{ { "A1"_pos, "C1"_pos } }));
+        ASSERT_EQUAL(pending, (Batches{ {} }));
+
+        clear();
+        sheet->ClearCell("A1"_pos);
+        ASSERT_EQUAL(changed, (Batches{ { "A1"_pos } }));
+        ASSERT_EQUAL(pending, (Batches{ { "B1"_pos, "C1"_pos } }));
+
+        read({ "B1"_pos, "C1"_pos });
+        clear();
+        concrete_sheet.InsertRows(0);
+        ASSERT_EQUAL(changed, (Batches{ { "B1"_pos, "C1"_pos, "B2"_pos, "C2"_pos } }));
+        ASSERT_EQUAL(pending, (Batches{ {} }));
+
+        clear();
+        concrete_sheet.FillDown("C2"_pos, { 3, 1 });
+        ASSERT_EQUAL(changed, (Batches{ {} }));
+        ASSERT_EQUAL(pending, (Batches{ { "C3"_pos, "C4"_pos } }));
+
+        concrete_sheet.Unsubscribe(id);
+        clear();
+        sheet->SetCell("A2"_pos, "7");
+        ASSERT(changed.empty());
+    }
+
+    void TestEarlyCutoff() {
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+
+        sheet->SetCell("A1"_pos, "1");
+        sheet->SetCell("B1"_pos, "=A1*0");
+        sheet->SetCell("C1"_pos, "=B1+A2");
+        sheet->SetCell("D1"_pos, "=C1*2");
+        ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetValue(), CellInterface::Value(0.0));
+        const SheetStats initial = concrete_sheet.GetStats();
+
+        // B1 stays zero, so C1 and D1 are current without evaluating
+        sheet->SetCell("A1"_pos, "5");
+        ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetValue(), CellInterface::Value(0.0));
+        const SheetStats after_masked = concrete_sheet.GetStats();
+
+        sheet->SetCell("A2"_pos, "3");
+        ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetValue(), CellInterface::Value(6.0));
+        const SheetStats after_changed = concrete_sheet.GetStats();
+
+        // the same number written again leaves the dependents alone
+        sheet->SetCell("A2"_pos, "3");
+        ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetValue(), CellInterface::Value(6.0));
+        const SheetStats after_rewritten = concrete_sheet.GetStats();
+
+        sheet->SetCell("B1"_pos, "=A1");
+        ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetValue(), CellInterface::Value(16.0));
+        sheet->ClearCell("A1"_pos);
+        ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetValue(), CellInterface::Value(6.0));
+
+        if constexpr (PROFILING_ENABLED) {
+            ASSERT_EQUAL(initial.evaluations, 3u);
+            ASSERT_EQUAL(after_masked.evaluations, 4u);
+            ASSERT_EQUAL(after_masked.early_cutoffs, 2u);
+            ASSERT_EQUAL(after_changed.evaluations, 6u);
+            ASSERT_EQUAL(after_rewritten.evaluations, 6u);
+            ASSERT_EQUAL(after_rewritten.early_cutoffs, 2u);
+        }
+    }
+
+    void TestRecalculation() {
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+
+        sheet->SetCell("A1"_pos, "1");
+        sheet->SetCell("B1"_pos, "=A1*2");
+        concrete_sheet.FillDown("B1"_pos, { 100, 1 });
+
+        auto is_current = [&](int row) {
+            return static_cast<const Cell*>(sheet->GetCell({ row, 1 }))->GetFormula()->IsCurrent();
+        };
+
+        Recalculation recalculation(concrete_sheet);
+        ASSERT_EQUAL(recalculation.GetProgress().total, 0u);
+
+        // a slice collects a row and evaluates its first formula whatever the budget
+        ASSERT(recalculation.Run(std::chrono::nanoseconds(0)) == Recalculation::Status::Running);
+        ASSERT_EQUAL(recalculation.GetProgress().evaluated, 1u);
+        ASSERT_EQUAL(recalculation.GetProgress().total, 1u);
+        ASSERT(is_current(0) && !is_current(1));
+
+        ASSERT(recalculation.Run(std::chrono::hours(1)) == Recalculation::Status::Done);
+        ASSERT_EQUAL(recalculation.GetProgress().evaluated, 100u);
+        ASSERT_EQUAL(recalculation.GetProgress().total, 100u);
+        ASSERT(is_current(99));
+
+        Recalculation current(concrete_sheet);
+        ASSERT(current.Run(std::chrono::hours(1)) == Recalculation::Status::Done);
+        ASSERT_EQUAL(current.GetProgress().total, 0u);
+        ASSERT(Recalculation(static_cast<Sheet&>(*CreateSheet())).GetStatus() == Recalculation::Status::Done);
+
+        // an edit supersedes the recalculation started before it
+        sheet->SetCell("A1"_pos, "2");
+        Recalculation superseded(concrete_sheet);
+        sheet->SetCell("A2"_pos, "1");
+        ASSERT(superseded.Run(std::chrono::hours(1)) == Recalculation::Status::Cancelled);
+        ASSERT(!is_current(0));
+
+        Recalculation cancelled(concrete_sheet);
+        cancelled.Cancel();
+        ASSERT(cancelled.Run(std::chrono::hours(1)) == Recalculation::Status::Cancelled);
+
+        Recalculation restarted(concrete_sheet);
+        ASSERT(restarted.Run(std::chrono::hours(1)) == Recalculation::Status::Done);
+        ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(), CellInterface::Value(4.0));
+    }
+
+    void TestViewportRecalculation() {
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+
+        sheet->SetCell("A1"_pos, "1");
+        sheet->SetCell("B1"_pos, "=A1*2");
+        concrete_sheet.FillDown("B1"_pos, { 100, 1 });
+        // on screen, reading a formula off screen
+        sheet->SetCell("D55"_pos, "=B5+1");
+
+        auto is_current = [&](Position pos) {
+            return static_cast<const Cell*>(sheet->GetCell(pos))->GetFormula()->IsCurrent();
+        };
+
+        const Sheet::ViewportId viewport = concrete_sheet.AddViewport("B50"_pos, { 10, 3 });
+        // overlapping the first one
+        concrete_sheet.AddViewport("B55"_pos, { 10, 1 });
+
+        Recalculation recalculation(concrete_sheet);
+        ASSERT_EQUAL(recalculation.GetProgress().visible, 16u);
+        ASSERT_EQUAL(recalculation.GetProgress().total, 16u);
+
+        recalculation.Run(std::chrono::nanoseconds(0));
+        ASSERT(is_current("B50"_pos) && !is_current("B1"_pos));
+
+        ASSERT(recalculation.RunVisible() == Recalculation::Status::Running);
+        ASSERT_EQUAL(recalculation.GetProgress().evaluated, 16u);
+        ASSERT_EQUAL(recalculation.GetProgress().total, 16u);
+        ASSERT(is_current("D55"_pos) && is_current("B5"_pos) && is_current("B64"_pos));
+        ASSERT(!is_current("B1"_pos) && !is_current("B65"_pos));
+
+        // the rows off screen are collected one per step
+        recalculation.Run(std::chrono::nanoseconds(0));
+        ASSERT_EQUAL(recalculation.GetProgress().total, 17u);
+        ASSERT(is_current("B1"_pos) && !is_current("B2"_pos));
+
+        ASSERT(recalculation.Run(std::chrono::hours(1)) == Recalculation::Status::Done);
+        // B5, read by D55, was not waiting any more when its row was collected
+        ASSERT_EQUAL(recalculation.GetProgress().total, 100u);
+        ASSERT(is_current("B1"_pos) && is_current("B100"_pos));
+
+        concrete_sheet.MoveViewport(viewport, "B1"_pos, { 5, 1 });
+        ASSERT_EQUAL(concrete_sheet.GetViewports().front().second.first, "B1"_pos);
+        concrete_sheet.RemoveViewport(viewport);
+        ASSERT_EQUAL(concrete_sheet.GetViewports().size(), 1u);
+    }
+
+    void TestBoundReferences() {
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        concrete_sheet.SetUndoLimit(10);
+
+        // the placeholder created for the reference becomes the cell set later
+        sheet->SetCell("C1"_pos, "=A3*2");
+        sheet->SetCell("A3"_pos, "4");
+        ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetValue(), CellInterface::Value(8.0));
+        sheet->ClearCell("A3"_pos);
+        ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetValue(), CellInterface::Value(0.0));
+
+        // moved cells keep their handles, deleted ones unbind the references
+        sheet->SetCell("A3"_pos, "5");
+        concrete_sheet.InsertRows(0);
+        ASSERT_EQUAL(sheet->GetCell("C2"_pos)->GetText(), "=A4*2");
+        sheet->SetCell("A4"_pos, "6");
+        ASSERT_EQUAL(sheet->GetCell("C2"_pos)->GetValue(), CellInterface::Value(12.0));
+        concrete_sheet.DeleteRows(3);
+        ASSERT_EQUAL(sheet->GetCell("C2"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Ref));
+
+        // restored contents are bound to the cells existing now
+        sheet->SetCell("D1"_pos, "=E1+1");
+        sheet->SetCell("D1"_pos, "1");
+        ASSERT(sheet->GetCell("E1"_pos) == nullptr);
+        ASSERT(concrete_sheet.Undo());
+        sheet->SetCell("E1"_pos, "2");
+        ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetValue(), CellInterface::Value(3.0));
+
+        // a formula outside the sheet looks its references up
+        ASSERT_EQUAL(std::get<double>(ParseFormula("E1*2")->Evaluate(*sheet)), 4.0);
+    }
+
+    void TestNumbers() {
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        concrete_sheet.SetUndoLimit(10);
+
+        // a number reads exactly as its numeric text does
+        concrete_sheet.SetNumber("A1"_pos, 42.5);
+        sheet->SetCell("B1"_pos, "42.5");
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), "42.5");
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetValue(), sheet->GetCell("B1"_pos)->GetValue());
+        ASSERT(sheet->GetCell("A1"_pos)->GetNumber() == 42.5);
+        ASSERT(!sheet->GetCell("B1"_pos)->GetNumber().has_value());
+
+        sheet->SetCell("C1"_pos, "=A1*2");
+        ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetValue(), CellInterface::Value(85.0));
+        concrete_sheet.SetNumber("A1"_pos, -0.1);
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), "-0.1");
+        ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetValue(), CellInterface::Value(-0.2));
+
+        const double values[] = { 1.0, 2.0, 1e21, -0.0, 0.125, 3.0 };
+        concrete_sheet.SetNumbers("A2"_pos, { 3, 2 }, values);
+        ASSERT_EQUAL(sheet->GetCell("B3"_pos)->GetText(), "-0");
+        ASSERT_EQUAL(sheet->GetCell("A3"_pos)->GetText(), "1e+21");
+        ASSERT_EQUAL(sheet->GetCell("B4"_pos)->GetText(), "3");
+        sheet->SetCell("C2"_pos, "=A2+B2+A4+B4");
+        ASSERT_EQUAL(sheet->GetCell("C2"_pos)->GetValue(), CellInterface::Value(6.125));
+
+        // the block is one undo step
+        ASSERT(concrete_sheet.Undo());
+        ASSERT(concrete_sheet.Undo());
+        ASSERT(sheet->GetCell("A2"_pos) == nullptr);
+        ASSERT(concrete_sheet.Redo());
+        ASSERT_EQUAL(sheet->GetCell("B2"_pos)->GetText(), "2");
+
+        // values formulas do not read as numbers stay texts
+        concrete_sheet.SetNumber("D1"_pos, std::numeric_limits<double>::infinity());
+        ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetText(), "inf");
+        sheet->SetCell("E1"_pos, "=D1");
+        ASSERT_EQUAL(sheet->GetCell("E1"_pos)->GetValue(), CellInterface::Value(FormulaError::Category::Value));
+
+        bool caught = false;
+        try {
+            concrete_sheet.SetNumbers("A16384"_pos, { 2, 1 }, values);
+        }
+        catch (const InvalidPositionException&) {
+            caught = true;
+        }
+
+        ASSERT(caught);
+    }
+
+    void TestReadRange() {
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+
+        concrete_sheet.SetNumber("A1"_pos, 1.5);
+        sheet->SetCell("B1"_pos, "=A1*2+C2");
+        sheet->SetCell("A2"_pos, "'text");
+        sheet->SetCell("B2"_pos, "=1/0");
+        sheet->SetCell("C2"_pos, "=A1");
+        // D1 is left a placeholder by the reference
+        sheet->SetCell("A3"_pos, "=D1");
+
+        double values[9];
+        ValueKind kinds[9];
+        concrete_sheet.ReadRange("A1"_pos, { 3, 3 }, values, kinds);
+
+        ASSERT_EQUAL(values[0], 1.5);
+        ASSERT(kinds[0] == ValueKind::Number);
+        // the formula in B1 waits for C2, which is read later in the pass
+        ASSERT_EQUAL(values[1], 4.5);
+        ASSERT(kinds[2] == ValueKind::Empty && values[2] == 0.0);
+        ASSERT(kinds[3] == ValueKind::Text && std::isnan(values[3]));
+        ASSERT(kinds[4] == ValueKind::Error && std::isnan(values[4]));
+        ASSERT_EQUAL(values[5], 1.5);
+        ASSERT(kinds[6] == ValueKind::Number && values[6] == 0.0);
+
+        double columns[4];
+        concrete_sheet.ReadRange("A1"_pos, { 2, 2 }, columns, nullptr, BufferLayout::ColumnMajor);
+        ASSERT_EQUAL(columns[0], 1.5);
+        ASSERT(std::isnan(columns[1]));
+        ASSERT_EQUAL(columns[2], 4.5);
+
+        // the block may reach past the stored cells
+        concrete_sheet.ReadRange("C3"_pos, { 2, 2 }, values, kinds);
+        ASSERT(kinds[0] == ValueKind::Empty && kinds[3] == ValueKind::Empty);
+
+        std::string_view texts[6];
+        concrete_sheet.ReadTextRange("A1"_pos, { 3, 2 }, texts, BufferLayout::ColumnMajor);
+        ASSERT_EQUAL(texts[1], "text");
+        ASSERT(texts[0].empty() && texts[3].empty() && texts[4].empty());
+
+        bool caught = false;
+        try {
+            concrete_sheet.ReadRange("A1"_pos, { 0, 1 }, values, kinds);
+        }
+        catch (const InvalidPositionException&) {
+            caught = true;
+        }
+
+        ASSERT(caught);
+    }
+
+    void TestReadRangeFormulas() {
+        // the same cells in two sheets, one read in blocks and one cell by cell
+        auto bulk = CreateSheet();
+        auto scalar = CreateSheet();
+
+        for (SheetInterface* sheet : { bulk.get(), scalar.get() }) {
+            const char* inputs[] = { "1", "abc", "0", "=1/0", "", " 3", "-2", "1e308", "=Z1", "4" };
+
+            for (int row = 0; row < 40; ++row) {
+                if (const char* input = inputs[row % 10]; *input != '\0') {
+                    sheet->SetCell({ row, 0 }, input);
+                }
+
+                sheet->SetCell({ row, 2 }, std::to_string(row % 3));
+            }
+
+            sheet->SetCell("B1"_pos, "=-(A1+1)/C1*A1*1e308");
+            static_cast<Sheet&>(*sheet).FillDown("B1"_pos, { 40, 1 });
+            // each copy reads the one above it
+            sheet->SetCell("D2"_pos, "=D1+B2/C2");
+            static_cast<Sheet&>(*sheet).FillDown("D2"_pos, { 39, 1 });
+        }
+
+        Sheet& concrete_sheet = static_cast<Sheet&>(*bulk);
+        double values[160];
+        ValueKind kinds[160];
+        concrete_sheet.ReadRange("A1"_pos, { 40, 4 }, values, kinds);
+
+        for (int row = 0; row < 40; ++row) {
+            for (int col : { 1, 3 }) {
+                const Position pos{ row, col };
+                ASSERT(bulk->GetCell(pos)->GetValue() == scalar->GetCell(pos)->GetValue());
+            }
+        }
+
+        // a changed input recomputes the formulas reading it
+        bulk->SetCell("A2"_pos, "2");
+        scalar->SetCell("A2"_pos, "2");
+        concrete_sheet.ReadRange("A1"_pos, { 40, 4 }, values, kinds);
+
+        for (int row = 0; row < 40; ++row) {
+            ASSERT(bulk->GetCell({ row, 1 })->GetValue() == scalar->GetCell({ row, 1 })->GetValue());
+            ASSERT(bulk->GetCell({ row, 3 })->GetValue() == scalar->GetCell({ row, 3 })->GetValue());
+        }
+    }
+
+    void TestReadRangeBatches() {
+        // three bands of rows batched apart
+        constexpr int ROWS = 192;
+        // the same cells in two sheets, one read in blocks and one cell by cell
+        auto bulk = CreateSheet();
+        auto scalar = CreateSheet();
+
+        for (SheetInterface* sheet : { bulk.get(), scalar.get() }) {
+            Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+
+            // batches take the numbers stored unboxed only
+            for (int row = 0; row < ROWS; ++row) {
+                concrete_sheet.SetNumber({ row, 1 }, row % 13 == 0 ? 1e308 : row % 7 - 3);
+                concrete_sheet.SetNumber({ row, 2 }, row % 5);
+            }
+
+            sheet->SetCell("B40"_pos, "abc");
+            sheet->SetCell("C41"_pos, "=B41");
+
+            sheet->SetCell("D1"_pos, "=B1/C1");
+            concrete_sheet.FillDown("D1"_pos, { ROWS, 1 });
+            sheet->SetCell("E1"_pos, "=B1*C1");
+            concrete_sheet.FillDown("E1"_pos, { ROWS, 1 });
+            // reads a formula further right in the row, before it is batched
+            sheet->SetCell("A1"_pos, "=D1-1");
+            concrete_sheet.FillDown("A1"_pos, { 10, 1 });
+
+            // each copy reads the one above it
+            sheet->SetCell("F1"_pos, "0");
+            sheet->SetCell("F2"_pos, "=F1+1");
+            concrete_sheet.FillDown("F2"_pos, { ROWS - 1, 1 });
+            // another code from the 21st row on, and one reading a deleted cell
+            sheet->SetCell("G1"_pos, "=B1+2");
+            concrete_sheet.FillDown("G1"_pos, { 20, 1 });
+            sheet->SetCell("G21"_pos, "=2-B21");
+            concrete_sheet.FillDown("G21"_pos, { ROWS - 20, 1 });
+            sheet->SetCell("G31"_pos, "=#REF!+1");
+        }
+
+        Sheet& concrete_sheet = static_cast<Sheet&>(*bulk);
+        const SheetStats before = concrete_sheet.GetStats();
+        std::vector<double> values(ROWS * 7);
+        std::vector<ValueKind> kinds(values.size());
+
+        const auto check = [&]() {
+            concrete_sheet.ReadRange("A1"_pos, { ROWS, 7 }, values.data(), kinds.data(), BufferLayout::ColumnMajor);
+
+            for (int col : { 0, 3, 4, 5, 6 }) {
+                for (int row = 0; row < (col == 0 ? 10 : ROWS); ++row) {
+                    const CellInterface::Value expected = scalar->GetCell({ row, col })->GetValue();
+                    ASSERT(bulk->GetCell({ row, col })->GetValue() == expected);
+
+                    const std::size_t index = col * ROWS + row;
+                    const double* number = std::get_if<double>(&expected);
+                    ASSERT(number != nullptr ? values[index] == *number : std::isnan(values[index]));
+                }
+            }
+        };
+
+        check();
+        ASSERT(std::holds_alternative<FormulaError>(bulk->GetCell("D1"_pos)->GetValue()));
+        ASSERT(std::holds_alternative<FormulaError>(bulk->GetCell("E14"_pos)->GetValue()));
+        ASSERT(kinds[3 * ROWS] == ValueKind::Error && kinds[4 * ROWS + 13] == ValueKind::Error);
+
+        if constexpr (PROFILING_ENABLED) {
+            const SheetStats batched = concrete_sheet.GetStats();
+            // D, E and G of every row but the ones read by A, the run of 20 at the top of G, too short
+            // to batch, and the ones reading the text, the formula or the deleted cell
+            ASSERT(batched.batched_evaluations - before.batched_evaluations > 500);
+            ASSERT(batched.batched_evaluations - before.batched_evaluations < ROWS * 3 - 30);
+        }
+
+        // a changed input recomputes the formulas reading it, evaluated ones are reused
+        for (SheetInterface* sheet : { bulk.get(), scalar.get() }) {
+            for (int row = 0; row < ROWS; row += 2) {
+                static_cast<Sheet&>(*sheet).SetNumber({ row, 2 }, row % 3);
+            }
+
+            sheet->SetCell("B40"_pos, "4");
+        }
+
+        check();
+        const SheetStats after = concrete_sheet.GetStats();
+        check();
+        ASSERT_EQUAL(concrete_sheet.GetStats().batched_evaluations, after.batched_evaluations);
+
+        // readers batching the same formulas or evaluating them one at a time settle on one value
+        for (SheetInterface* sheet : { bulk.get(), scalar.get() }) {
+            for (int row = 0; row < ROWS; ++row) {
+                static_cast<Sheet&>(*sheet).SetNumber({ row, 2 }, row % 4 + 1);
+            }
+        }
+
+        std::vector<std::thread> readers;
+        std::atomic<int> mismatched = 0;
+
+        for (int i = 0; i < 4; ++i) {
+            readers.emplace_back([&, i] {
+                std::vector<double> block(ROWS * 7);
+
+                if (i % 2 == 0) {
+                    concrete_sheet.ReadRange("A1"_pos, { ROWS, 7 }, block.data(), nullptr);
+                    return;
+                }
+
+                for (int row = ROWS - 1; row >= 0; --row) {
+                    if (!(bulk->GetCell({ row, 4 })->GetValue() == scalar->GetCell({ row, 4 })->GetValue())) {
+                        ++mismatched;
+                    }
+                }
+            });
+        }
+
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+
+        ASSERT_EQUAL(mismatched.load(), 0);
+        check();
+    }
+
+    void TestSnapshots() {
+        auto sheet = CreateSheet();
+        Sheet& writer = static_cast<Sheet&>(*sheet);
+
+        ASSERT_EQUAL(writer.ReadSnapshot()->GetVersion(), 0u);
+        ASSERT(writer.ReadSnapshot()->GetCell("A1"_pos) == nullptr);
+
+        sheet->SetCell("A1"_pos, "1");
+        sheet->SetCell("B2"_pos, "=A1*2");
+        writer.PublishSnapshot();
+
+        {
+            auto snapshot = writer.ReadSnapshot();
+            sheet->SetCell("A1"_pos, "5");
+
+            ASSERT_EQUAL(snapshot->GetVersion(), 1u);
+            ASSERT_EQUAL(snapshot->GetPrintableSize(), (Size{ 2, 2 }));
+            ASSERT_EQUAL(snapshot->GetCell("A1"_pos)->text, "1");
+            ASSERT_EQUAL(snapshot->GetCell("B2"_pos)->value, CellInterface::Value(2.0));
+        }
+
+        writer.PublishSnapshot();
+        ASSERT_EQUAL(writer.ReadSnapshot()->GetCell("B2"_pos)->value, CellInterface::Value(10.0));
+    }
+
+    void TestSnapshotsConcurrentReaders() {
+        auto sheet = CreateSheet();
+        Sheet& writer = static_cast<Sheet&>(*sheet);
+        sheet->SetCell("B1"_pos, "=A1*2");
+
+        std::atomic<bool> done = false;
+        std::atomic<int> inconsistent = 0;
+        std::vector<std::thread> readers;
+
+        for (int i = 0; i < 4; ++i) {
+            readers.emplace_back([&] {
+                std::uint64_t last_version = 0;
+
+                while (!done) {
+                    auto snapshot = writer.ReadSnapshot();
+                    const SheetSnapshot::CellEntry* a1 = snapshot->GetCell("A1"_pos);
+                    const SheetSnapshot::CellEntry* b1 = snapshot->GetCell("B1"_pos);
+
+                    if (snapshot->GetVersion() < last_version || (a1 != nullptr
+                        && std::get<double>(b1->value) != 2 * std::stod(std::get<std::string>(a1->value)))) {
+
+                        ++inconsistent;
+                    }
+
+                    last_version = snapshot->GetVersion();
+                }
+            });
+        }
+
+        for (int i = 0; i < 2000; ++i) {
+            sheet->SetCell("A1"_pos, std::to_string(i));
+            writer.PublishSnapshot();
+        }
+
+        done = true;
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+
+        ASSERT_EQUAL(inconsistent.load(), 0);
+        ASSERT_EQUAL(writer.ReadSnapshot()->GetVersion(), 2000u);
+    }
+
+    void TestConcurrentFormulaEvaluation() {
+        auto sheet = CreateSheet();
+        sheet->SetCell("A1"_pos, "1");
+        for (int row = 1; row < 200; ++row) {
+            sheet->SetCell({ row, 0 }, "=A" + std::to_string(row) + "+1");
+        }
+
+        for (int round = 0; round < 20; ++round) {
+            sheet->SetCell("A1"_pos, std::to_string(round));
+
+            std::atomic<int> mismatched = 0;
+            std::vector<std::thread> readers;
+            for (int i = 0; i < 8; ++i) {
+                readers.emplace_back([&, i] {
+                    for (int row = 199 - i; row > 0; --row) {
+                        if (!(sheet->GetCell({ row, 0 })->GetValue() == CellInterface::Value(double(round + row)))) {
+                            ++mismatched;
+                        }
+                    }
+                });
+            }
+
+            for (std::thread& reader : readers) {
+                reader.join();
+            }
+
+            ASSERT_EQUAL(mismatched.load(), 0);
+        }
+    }
+
+    void TestValueCacheBudget() {
+        auto sheet = CreateSheet();
+        Sheet& concrete_sheet = static_cast<Sheet&>(*sheet);
+        ValueCache& cache = concrete_sheet.GetValueCache();
+        ASSERT_EQUAL(cache.GetBudget(), 0u);
+
+        for (int row = 0; row < 100; ++row) {
+            concrete_sheet.SetNumber({ row, 0 }, row);
+        }
+
+        sheet->SetCell("B1"_pos, "=A1*2");
+        concrete_sheet.FillDown("B1"_pos, { 100, 1 });
+        // C1 feeds enough formulas to be spared
+        sheet->SetCell("C1"_pos, "=B1+1");
+        for (std::size_t col = 0; col < ValueCache::HOT_DEPENDENTS; ++col) {
+            sheet->SetCell({ 0, 3 + static_cast<int>(col) }, "=C1*2");
+        }
+
+
+        const auto is_current = [&sheet](Position pos) {
+            return static_cast<const Cell*>(sheet->GetCell(pos))->GetFormula()->IsCurrent();
+        };
+
+        const auto read_column = [&sheet](int col) {
+            for (int row = 0; row < 100; ++row) {
+                ASSERT_EQUAL(sheet->GetCell({ row, col })->GetValue(), CellInterface::Value(row * 2.0));
+            }
+        };
+
+        // without a budget every value stays
+        read_column(1);
+        ASSERT_EQUAL(cache.GetSize(), 0u);
+        ASSERT(is_current("B1"_pos) && is_current("B100"_pos));
+
+        cache.SetBudget(20);
+        ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetValue(), CellInterface::Value(2.0));
+        const std::uint64_t changed_at = static_cast<const Cell*>(sheet->GetCell("B1"_pos))->GetChangedAt();
+        const SheetStats before = concrete_sheet.GetStats();
+
+        read_column(1);
+        ASSERT(cache.GetSize() <= 20);
+        ASSERT(is_current("C1"_pos) && !is_current("B1"_pos) && is_current("B100"_pos));
+
+        // the values were all current, to be evicted in turn
+        const SheetStats scanned = concrete_sheet.GetStats();
+
+        if constexpr (PROFILING_ENABLED) {
+            ASSERT(scanned.evictions - before.evictions >= 80);
+            ASSERT_EQUAL(scanned.cache_misses, before.cache_misses);
+        }
+
+        // an evicted value is evaluated again when read, keeping its date
+        ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(), CellInterface::Value(0.0));
+        ASSERT(is_current("B1"_pos));
+        ASSERT_EQUAL(static_cast<const Cell*>(sheet->GetCell("B1"_pos))->GetChangedAt(), changed_at);
+
+        // an evicted value is still invalidated along with its dependents
+        read_column(1);
+        ASSERT(!is_current("B1"_pos) && is_current("C1"_pos));
+
+        if constexpr (PROFILING_ENABLED) {
+            ASSERT(concrete_sheet.GetStats().cache_misses - scanned.cache_misses >= 80);
+        }
+
+        concrete_sheet.SetNumber("A1"_pos, 5);
+        ASSERT_EQUAL(sheet->GetCell("D1"_pos)->GetValue(), CellInterface::Value(22.0));
+        concrete_sheet.SetNumber("A1"_pos, 0);
+
+        // a smaller budget evicts at once, the deleted cells leave the cache
+        cache.SetBudget(5);
+        ASSERT(cache.GetSize() <= 5);
+        concrete_sheet.DeleteRows(10, 50);
+
+        for (int row = 0; row < 50; ++row) {
+            const double number = row < 10 ? row : row + 50;
+            ASSERT_EQUAL(sheet->GetCell({ row, 1 })->GetValue(), CellInterface::Value(number * 2));
+        }
+
+        ASSERT(cache.GetSize() <= 5);
+
+        // concurrent readers evict each other's values
+        std::vector<std::thread> readers;
+        std::atomic<int> mismatched = 0;
+
+        for (int i = 0; i < 4; ++i) {
+            readers.emplace_back([&, i] {
+                for (int pass = 0; pass < 20; ++pass) {
+                    for (int row = i; row < 50; ++row) {
+                        const double number = row < 10 ? row : row + 50;
+
+                        if (!(sheet->GetCell({ row, 1 })->GetValue() == CellInterface::Value(number * 2))) {
+                            ++mismatched;
+                        }
+                    }
+                }
+            });
+        }
+
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+
+        ASSERT_EQUAL(mismatched.load(), 0);
+        ASSERT(cache.GetSize() <= 5);
+        cache.SetBudget(0);
+        ASSERT_EQUAL(cache.GetSize(), 0u);
+    }
+
+    void TestProfiler() {
+        auto sheet = CreateSheet();
+        Profiler& profiler = static_cast<Sheet&>(*sheet).GetProfiler();
+        profiler.SetTracing(true);
+
+        sheet->SetCell("A1"_pos, "1");
+        sheet->SetCell("A2"_pos, "=A1+1");
+        sheet->SetCell("A3"_pos, "=A2+1");
+        sheet->GetCell("A3"_pos)->GetValue();
+        sheet->GetCell("A3"_pos)->GetValue();
+        sheet->SetCell("A1"_pos, "2");
+
+        const SheetStats stats = static_cast<Sheet&>(*sheet).GetStats();
+        std::ostringstream trace;
+        profiler.WriteTrace(trace);
+
+        if constexpr (!PROFILING_ENABLED) {
+            ASSERT_EQUAL(stats.parses, 0u);
+            ASSERT_EQUAL(stats.cache_hits, 0u);
+            ASSERT_EQUAL(trace.str(), "{\"traceEvents\":[\n],\"displayTimeUnit\":\"ns\"}\n");
+            return;
+        }
+
+        ASSERT_EQUAL(stats.parses, 2u);
+        ASSERT_EQUAL(stats.evaluations, 2u);
+        // both are a reference plus a constant
+        ASSERT_EQUAL(stats.kernel_evaluations, 2u);
+        ASSERT_EQUAL(stats.evaluated_operations, 6u);
+        ASSERT_EQUAL(stats.cache_misses, 2u);
+        ASSERT_EQUAL(stats.cache_hits, 1u);
+        ASSERT_EQUAL(stats.invalidations, 2u);
+        ASSERT_EQUAL(stats.max_invalidation_fan_out, 2u);
+        ASSERT_EQUAL(stats.cycle_check_visits, 2u);
+        ASSERT_EQUAL(stats.max_dependency_depth, 2u);
+        ASSERT(trace.str().find("{\"name\":\"=A2+1\",\"cat\":\"evaluate\"") != std::string::npos);
+
+        profiler.Reset();
+        ASSERT_EQUAL(profiler.GetStats().parses, 0u);
+    }
 } // unnamed namespace
 
 int main() {
     TestRunner tr;
     RUN_TEST(tr, TestPositionAndStringConversion);
     RUN_TEST(tr, TestPositionToStringInvalid);
+    RUN_TEST(tr, TestPositionToChars);
     RUN_TEST(tr, TestStringToPositionInvalid);
     RUN_TEST(tr, TestEmpty);
     RUN_TEST(tr, TestInvalidPosition);
     RUN_TEST(tr, TestSetCellPlainText);
+    RUN_TEST(tr, TestTextInterning);
+    RUN_TEST(tr, TestSpilledTexts);
+    RUN_TEST(tr, TestEditLogRecovery);
+    RUN_TEST(tr, TestEditLogLostReferences);
+    RUN_TEST(tr, TestEditLogGroupCommit);
     RUN_TEST(tr, TestClearCell);
+    RUN_TEST(tr, TestCellStorageDensity);
+    RUN_TEST(tr, TestPlaceholderCells);
+    RUN_TEST(tr, TestMemoryStatsCountFormulas);
+    RUN_TEST(tr, TestMemorySteadyUnderChurn);
     RUN_TEST(tr, TestFormulaArithmetic);
     RUN_TEST(tr, TestFormulaReferences);
     RUN_TEST(tr, TestFormulaExpressionFormatting);
     RUN_TEST(tr, TestFormulaReferencedCells);
     RUN_TEST(tr, TestErrorValue);
+    RUN_TEST(tr, TestReadViews);
     RUN_TEST(tr, TestErrorArithmetic);
+    RUN_TEST(tr, TestFormulaKernels);
     RUN_TEST(tr, TestEmptyCellTreatedAsZero);
     RUN_TEST(tr, TestFormulaInvalidPosition);
     RUN_TEST(tr, TestPrint);
     RUN_TEST(tr, TestCellReferences);
     RUN_TEST(tr, TestFormulaIncorrect);
     RUN_TEST(tr, TestCellCircularReferences);
+    RUN_TEST(tr, TestInsertDeleteRows);
+    RUN_TEST(tr, TestInsertDeleteCols);
+    RUN_TEST(tr, TestInvalidShiftCounts);
+    RUN_TEST(tr, TestCopyRange);
+    RUN_TEST(tr, TestFillDown);
+    RUN_TEST(tr, TestUndoRedo);
+    RUN_TEST(tr, TestChangeSubscription);
+    RUN_TEST(tr, TestEarlyCutoff);
+    RUN_TEST(tr, TestRecalculation);
+    RUN_TEST(tr, TestViewportRecalculation);
+    RUN_TEST(tr, TestBoundReferences);
+    RUN_TEST(tr, TestNumbers);
+    RUN_TEST(tr, TestReadRange);
+    RUN_TEST(tr, TestReadRangeFormulas);
+    RUN_TEST(tr, TestReadRangeBatches);
+    RUN_TEST(tr, TestSnapshots);
+    RUN_TEST(tr, TestSnapshotsConcurrentReaders);
+    RUN_TEST(tr, TestConcurrentFormulaEvaluation);
+    RUN_TEST(tr, TestProfiler);
+    RUN_TEST(tr, TestValueCacheBudget);
 }
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include <iomanip>
+#include <ostream>
+#include <thread>
+
+#include "profiler.h"
+
+thread_local std::size_t Profiler::evaluation_depth_ = 0;
+
+namespace {
+    void WriteEscaped(std::ostream& output, std::string_view text) {
+        for (const char c : text) {
+            if (c == '"' || c == '\\') {
+                output << '\\' << c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20) {
+                output << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+            }
+            else {
+                output << c;
+            }
+        }
+    }
+} // unnamed namespace
+
+Profiler::Profiler()
+    : origin_(Clock::now()) {
+}
+
+SheetStats Profiler::GetStats() const noexcept {
+    SheetStats stats;
+    stats.parses = parses_.load(std::memory_order_relaxed);
+    stats.parse_time = std::chrono::nanoseconds(parse_time_.load(std::memory_order_relaxed));
+    stats.evaluations = evaluations_.load(std::memory_order_relaxed);
+    stats.evaluation_time = std::chrono::nanoseconds(evaluation_time_.load(std::memory_order_relaxed));
+    stats.kernel_evaluations = kernel_evaluations_.load(std::memory_order_relaxed);
+    stats.evaluated_operations = evaluated_operations_.load(std::memory_order_relaxed);
+    stats.batched_evaluations = batched_evaluations_.load(std::memory_order_relaxed);
+    stats.cache_hits = cache_hits_.load(std::memory_order_relaxed);
+    stats.cache_misses = cache_misses_.load(std::memory_order_relaxed);
+    stats.early_cutoffs = early_cutoffs_.load(std::memory_order_relaxed);
+    stats.evictions = evictions_.load(std::memory_order_relaxed);
+    stats.invalidations = invalidations_.load(std::memory_order_relaxed);
+    stats.max_invalidation_fan_out = max_invalidation_fan_out_.load(std::memory_order_relaxed);
+    stats.cycle_check_visits = cycle_check_visits_.load(std::memory_order_relaxed);
+    stats.max_dependency_depth = max_dependency_depth_.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+void Profiler::Reset() noexcept {
+    for (std::atomic<std::uint64_t>* counter : { &parses_, &parse_time_, &evaluations_, &evaluation_time_,
+        &kernel_evaluations_, &evaluated_operations_, &batched_evaluations_, &cache_hits_, &cache_misses_, &early_cutoffs_, &evictions_, &invalidations_, &max_invalidation_fan_out_,
+        &cycle_check_visits_, &max_dependency_depth_ }) {
+
+        counter->store(0, std::memory_order_relaxed);
+    }
+
+    std::lock_guard guard(trace_mutex_);
+    trace_.clear();
+}
+
+void Profiler::SetTracing(bool enabled) noexcept {
+    tracing_.store(enabled, std::memory_order_relaxed);
+}
+
+void Profiler::WriteTrace(std::ostream& output) const {
+    using Microseconds = std::chrono::duration<double, std::micro>;
+    std::lock_guard guard(trace_mutex_);
+
+    output << "{\"traceEvents\":[";
+
+    bool first = true;
+    for (const TraceEvent& event : trace_) {
+        if (!first) {
+            output << ',';
+        }
+        first = false;
+
+        output << "\n{\"name\":\"";
+        WriteEscaped(output, event.name);
+        output << "\",\"cat\":\"" << (event.event == Event::Parse ? "parse" : "evaluate")
+            << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+            << ",\"ts\":" << Microseconds(event.start - origin_).count()
+            << ",\"dur\":" << Microseconds(event.duration).count()
+            << ",\"args\":{\"depth\":" << event.depth << "}}";
+    }
+
+    output << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+void Profiler::UpdateMax(std::atomic<std::uint64_t>& max, std::uint64_t value) noexcept {
+    std::uint64_t current = max.load(std::memory_order_relaxed);
+
+    while (current < value && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void Profiler::Record(Event event, std::string_view name, Clock::time_point start, std::size_t depth) noexcept {
+    const Clock::duration duration = Clock::now() - start;
+    const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+
+    if (event == Event::Parse) {
+        parses_.fetch_add(1, std::memory_order_relaxed);
+        parse_time_.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+    else {
+        evaluations_.fetch_add(1, std::memory_order_relaxed);
+        evaluation_time_.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    if (!tracing_.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    try {
+        std::lock_guard guard(trace_mutex_);
+        trace_.push_back({ std::string(name), event, start, duration, depth,
+            std::hash<std::thread::id>{}(std::this_thread::get_id()) });
+    }
+    catch (...) {
+        // a lost trace event must not break the sheet
+    }
+}
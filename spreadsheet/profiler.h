@@ -0,0 +1,192 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef SPREADSHEET_PROFILING
+inline constexpr bool PROFILING_ENABLED = true;
+#else
+inline constexpr bool PROFILING_ENABLED = false;
+#endif
+
+struct SheetStats final {
+    std::uint64_t parses = 0;
+    std::chrono::nanoseconds parse_time{ 0 };
+    std::uint64_t evaluations = 0;
+    std::chrono::nanoseconds evaluation_time{ 0 };
+    // evaluations a kernel served instead of a walk of the formula tree
+    std::uint64_t kernel_evaluations = 0;
+    // the references, constants and operators the evaluated formulas consist of, unary pluses aside
+    std::uint64_t evaluated_operations = 0;
+    // formulas a range read evaluated a column batch at a time, which the counts above leave out
+    std::uint64_t batched_evaluations = 0;
+    std::uint64_t cache_hits = 0;
+    std::uint64_t cache_misses = 0;
+    // stale formulas found current without evaluating, as none of their inputs changed
+    std::uint64_t early_cutoffs = 0;
+    // formula values the value cache dropped to stay within its budget, read again as misses
+    std::uint64_t evictions = 0;
+    std::uint64_t invalidations = 0;
+    std::uint64_t max_invalidation_fan_out = 0;
+    std::uint64_t cycle_check_visits = 0;
+    std::uint64_t max_dependency_depth = 0;
+};
+
+// Collects the sheet's hot-path counters and, while tracing is on, Chrome trace events.
+// Every hook is discarded at compile time unless SPREADSHEET_PROFILING is defined.
+class Profiler final {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Event {
+        Parse,
+        Evaluate,
+    };
+
+    // measures a parse or an evaluation from construction to destruction
+    class Timer final {
+    public:
+        Timer(Profiler& profiler, Event event, std::string_view name) noexcept;
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+        ~Timer() noexcept;
+
+    private:
+        Profiler& profiler_;
+        Event event_;
+        std::string_view name_;
+        Clock::time_point start_;
+    };
+
+    Profiler();
+
+    void CountBatchedEvaluation() noexcept;
+    void CountCacheHit() noexcept;
+    void CountCacheMiss() noexcept;
+    void CountCycleCheck(std::size_t visited) noexcept;
+    void CountEarlyCutoff() noexcept;
+    void CountEviction() noexcept;
+    // a formula of the given number of operations is evaluated, by a kernel or by walking its tree
+    void CountFormulaExecution(bool by_kernel, std::size_t operations) noexcept;
+    void CountInvalidation(std::size_t fan_out) noexcept;
+
+    SheetStats GetStats() const noexcept;
+    void Reset() noexcept;
+    void SetTracing(bool enabled) noexcept;
+    // writes the recorded events in the Chrome trace event format, viewable in chrome://tracing
+    void WriteTrace(std::ostream& output) const;
+
+private:
+    struct TraceEvent final {
+        std::string name;
+        Event event;
+        Clock::time_point start;
+        Clock::duration duration;
+        std::size_t depth;
+        std::size_t thread;
+    };
+
+    static void UpdateMax(std::atomic<std::uint64_t>& max, std::uint64_t value) noexcept;
+    void Record(Event event, std::string_view name, Clock::time_point start, std::size_t depth) noexcept;
+
+    // nesting of the evaluations running on the current thread
+    static thread_local std::size_t evaluation_depth_;
+
+    std::atomic<std::uint64_t> parses_ = 0;
+    std::atomic<std::uint64_t> parse_time_ = 0;
+    std::atomic<std::uint64_t> evaluations_ = 0;
+    std::atomic<std::uint64_t> evaluation_time_ = 0;
+    std::atomic<std::uint64_t> kernel_evaluations_ = 0;
+    std::atomic<std::uint64_t> evaluated_operations_ = 0;
+    std::atomic<std::uint64_t> batched_evaluations_ = 0;
+    std::atomic<std::uint64_t> cache_hits_ = 0;
+    std::atomic<std::uint64_t> cache_misses_ = 0;
+    std::atomic<std::uint64_t> early_cutoffs_ = 0;
+    std::atomic<std::uint64_t> evictions_ = 0;
+    std::atomic<std::uint64_t> invalidations_ = 0;
+    std::atomic<std::uint64_t> max_invalidation_fan_out_ = 0;
+    std::atomic<std::uint64_t> cycle_check_visits_ = 0;
+    std::atomic<std::uint64_t> max_dependency_depth_ = 0;
+
+    std::atomic<bool> tracing_ = false;
+    const Clock::time_point origin_;
+    mutable std::mutex trace_mutex_;
+    std::vector<TraceEvent> trace_;
+};
+
+inline Profiler::Timer::Timer(Profiler& profiler, Event event, std::string_view name) noexcept
+    : profiler_(profiler)
+    , event_(event)
+    , name_(name) {
+
+    if constexpr (PROFILING_ENABLED) {
+        start_ = Clock::now();
+
+        if (event_ == Event::Evaluate) {
+            UpdateMax(profiler_.max_dependency_depth_, ++evaluation_depth_);
+        }
+    }
+}
+
+inline Profiler::Timer::~Timer() noexcept {
+    if constexpr (PROFILING_ENABLED) {
+        const std::size_t depth = event_ == Event::Evaluate ? evaluation_depth_-- : 0;
+        profiler_.Record(event_, name_, start_, depth);
+    }
+}
+
+inline void Profiler::CountBatchedEvaluation() noexcept {
+    if constexpr (PROFILING_ENABLED) {
+        batched_evaluations_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+inline void Profiler::CountCacheHit() noexcept {
+    if constexpr (PROFILING_ENABLED) {
+        cache_hits_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+inline void Profiler::CountCacheMiss() noexcept {
+    if constexpr (PROFILING_ENABLED) {
+        cache_misses_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+inline void Profiler::CountCycleCheck(std::size_t visited) noexcept {
+    if constexpr (PROFILING_ENABLED) {
+        cycle_check_visits_.fetch_add(visited, std::memory_order_relaxed);
+    }
+}
+
+inline void Profiler::CountEarlyCutoff() noexcept {
+    if constexpr (PROFILING_ENABLED) {
+        early_cutoffs_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+inline void Profiler::CountEviction() noexcept {
+    if constexpr (PROFILING_ENABLED) {
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+inline void Profiler::CountFormulaExecution(bool by_kernel, std::size_t operations) noexcept {
+    if constexpr (PROFILING_ENABLED) {
+        kernel_evaluations_.fetch_add(by_kernel ? 1 : 0, std::memory_order_relaxed);
+        evaluated_operations_.fetch_add(operations, std::memory_order_relaxed);
+    }
+}
+
+inline void Profiler::CountInvalidation(std::size_t fan_out) noexcept {
+    if constexpr (PROFILING_ENABLED) {
+        invalidations_.fetch_add(fan_out, std::memory_order_relaxed);
+        UpdateMax(max_invalidation_fan_out_, fan_out);
+    }
+}
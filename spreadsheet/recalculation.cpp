@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <utility>
+
+#include "recalculation.h"
+#include "sheet.h"
+
+Recalculation::Recalculation(const Sheet& sheet)
+    : sheet_(sheet)
+    , revision_(sheet.GetRevision()) {
+
+    for (const auto& [id, viewport] : sheet.GetViewports()) {
+        sheet.GetStorage().ForEachInRange(viewport.first, viewport.size, [&](Position pos, const Cell& cell) {
+            // the overlaps go with the earlier viewport
+            const bool collected = std::any_of(viewports_.begin(), viewports_.end(), [pos](const Viewport& earlier) {
+                return earlier.Contains(pos);
+            });
+
+            if (!collected) {
+                Collect(pos, cell);
+            }
+        });
+
+        viewports_.push_back(viewport);
+    }
+
+    visible_ = pending_.size();
+    off_screen_collected_ = sheet.GetStorage().GetRowEnd() == 0;
+
+    if (visible_ == 0 && off_screen_collected_) {
+        status_ = Status::Done;
+    }
+}
+
+void Recalculation::Cancel() noexcept {
+    if (status_ == Status::Running) {
+        status_ = Status::Cancelled;
+    }
+}
+
+void Recalculation::Collect(Position pos, const Cell& cell) {
+    if (const detail::FormulaImpl* formula = cell.GetFormula(); formula != nullptr && !formula->IsCurrent()) {
+        pending_.push_back(pos);
+    }
+}
+
+void Recalculation::CollectNextRow() {
+    const int row = next_row_++;
+    // the columns the viewports cover in the row, which were collected with them
+    std::vector<std::pair<int, int>> covered;
+
+    for (const Viewport& viewport : viewports_) {
+        if (row >= viewport.first.row && row < viewport.first.row + viewport.size.rows) {
+            covered.emplace_back(viewport.first.col, viewport.first.col + viewport.size.cols);
+        }
+    }
+
+    std::sort(covered.begin(), covered.end());
+
+    const auto collect_between = [this, row](int first_col, int end_col) {
+        if (first_col < end_col) {
+            sheet_.GetStorage().ForEachInRange({ row, first_col }, { 1, end_col - first_col }, [this](Position pos, const Cell& cell) {
+                Collect(pos, cell);
+            });
+        }
+    };
+
+    int col = 0;
+
+    for (const auto& [first_col, end_col] : covered) {
+        collect_between(col, first_col);
+        col = std::max(col, end_col);
+    }
+
+    collect_between(col, Position::MAX_COLS);
+    off_screen_collected_ = next_row_ >= sheet_.GetStorage().GetRowEnd();
+}
+
+bool Recalculation::EvaluateNext() {
+    if (evaluated_ == pending_.size() && !off_screen_collected_) {
+        CollectNextRow();
+    }
+
+    if (evaluated_ < pending_.size()) {
+        // the positions are looked up again, as the cells may have been erased
+        // by a change not counted as a revision, like the release of a placeholder
+        if (const Cell* cell = sheet_.GetStorage().Find(pending_[evaluated_])) {
+            if (const detail::FormulaImpl* formula = cell->GetFormula(); formula != nullptr && !formula->IsCurrent()) {
+                cell->GetValueView();
+            }
+        }
+
+        ++evaluated_;
+    }
+
+    if (evaluated_ == pending_.size() && off_screen_collected_) {
+        status_ = Status::Done;
+    }
+
+    return status_ == Status::Done;
+}
+
+Recalculation::Progress Recalculation::GetProgress() const noexcept {
+    return { evaluated_, visible_, pending_.size() };
+}
+
+Recalculation::Status Recalculation::GetStatus() const noexcept {
+    return status_;
+}
+
+bool Recalculation::IsSuperseded() {
+    if (status_ == Status::Running && sheet_.GetRevision() != revision_) {
+        status_ = Status::Cancelled;
+    }
+
+    return status_ != Status::Running;
+}
+
+Recalculation::Status Recalculation::Run(std::chrono::nanoseconds budget) {
+    if (IsSuperseded()) {
+        return status_;
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + budget;
+
+    while (!EvaluateNext() && std::chrono::steady_clock::now() < deadline) {
+    }
+
+    return status_;
+}
+
+Recalculation::Status Recalculation::RunVisible() {
+    if (IsSuperseded()) {
+        return status_;
+    }
+
+    while (evaluated_ < visible_ && !EvaluateNext()) {
+    }
+
+    return status_;
+}
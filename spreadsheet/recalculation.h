@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common.h"
+
+class Cell;
+class Sheet;
+struct Viewport;
+
+// Evaluates the formulas an edit left dirty in slices of bounded time, so that the writer
+// thread can spread a large recalculation over its idle moments instead of blocking the
+// next read on it. The formulas in the viewports of the sheet come first, then the others,
+// each group in row-major order and each formula pulling in the ones it references. The
+// formulas off screen are collected a row at a time as the evaluation reaches them, so that
+// no slice scans the whole sheet. The next edit of the sheet cancels the recalculation, as it
+// outdates the collected formulas; a new one is started for the edited sheet.
+class Recalculation final {
+public:
+    enum class Status : std::uint8_t {
+        Running,
+        Done,
+        Cancelled,
+    };
+
+    struct Progress final {
+        std::size_t evaluated = 0;
+        // the first of the collected formulas, the ones in the viewports
+        std::size_t visible = 0;
+        // collected so far, the formulas off screen only once the evaluation reaches their rows
+        std::size_t total = 0;
+    };
+
+    // collects the formulas waiting for evaluation, the sheet must outlive the recalculation
+    explicit Recalculation(const Sheet& sheet);
+
+    void Cancel() noexcept;
+    Progress GetProgress() const noexcept;
+    Status GetStatus() const noexcept;
+    // evaluates formulas until the budget is spent, making at least one step per call: a row
+    // collected off screen and its first formula; a single formula with a long chain of dirty
+    // references may overrun the budget. Must be called from the writer thread
+    Status Run(std::chrono::nanoseconds budget);
+    // evaluates the formulas left in the viewports whatever the time they take, the least
+    // an edit has to wait for before the view is redrawn. Must be called from the writer thread
+    Status RunVisible();
+
+private:
+    void Collect(Position pos, const Cell& cell);
+    // collects the formulas of the next row outside the viewports
+    void CollectNextRow();
+    // evaluates the next collected formula, collecting the next row first once all of them
+    // are evaluated; returns whether the recalculation is done
+    bool EvaluateNext();
+    bool IsSuperseded();
+
+    const Sheet& sheet_;
+    // the revision of the sheet the formulas were collected at
+    std::uint64_t revision_;
+    // as they were when the recalculation started
+    std::vector<Viewport> viewports_;
+    std::vector<Position> pending_;
+    std::size_t visible_ = 0;
+    std::size_t evaluated_ = 0;
+    // the next row to collect the formulas off screen from
+    int next_row_ = 0;
+    bool off_screen_collected_ = false;
+    Status status_ = Status::Running;
+};
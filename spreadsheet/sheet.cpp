@@ -1,13 +1,20 @@
 #include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "sheet.h"
 
 namespace detail {
     struct Visitor final {
-        void operator()(std::ostream& os, const std::string& text) {
+        void operator()(std::ostream& os, std::string_view text) {
             os << text;
         }
 
@@ -21,72 +28,424 @@ namespace detail {
     };
 } // namespace detail
 
+namespace {
+    using PastedImpls = std::unordered_map<Position, const detail::Impl*, PositionHasher>;
+
+    // the number of rows or columns inserted or deleted, the direction being given by the call
+    void CheckShiftCount(int count) {
+        if (count <= 0) {
+            throw InvalidPositionException("Invalid number of rows or columns");
+        }
+    }
+
+    // a depth-first search through the references, where the pasted contents replace
+    // the current ones; every cell is visited once whatever the number of pasted formulas
+    bool HasPastedCycle(const CellStorage& storage, const PastedImpls& pasted, Profiler& profiler) {
+        enum class Mark {
+            InProgress,
+            Done,
+        };
+
+        auto get_references = [&storage, &pasted](Position pos) -> std::vector<Position> {
+            if (auto pasted_impl = pasted.find(pos); pasted_impl != pasted.end()) {
+                return pasted_impl->second != nullptr ? pasted_impl->second->GetReferencedCells() : std::vector<Position>{};
+            }
+
+            const Cell* taken_cell = storage.Find(pos);
+            return taken_cell != nullptr ? taken_cell->GetReferencedCells() : std::vector<Position>{};
+        };
+
+        std::unordered_map<Position, Mark, PositionHasher> marks;
+        // the cells on the current path with their references left to visit
+        std::vector<std::pair<Position, std::vector<Position>>> path;
+        bool cycle_found = false;
+
+        for (auto start = pasted.begin(); start != pasted.end() && !cycle_found; ++start) {
+            if (!marks.try_emplace(start->first, Mark::InProgress).second) {
+                continue;
+            }
+            path.emplace_back(start->first, get_references(start->first));
+
+            while (!path.empty() && !cycle_found) {
+                auto& [pos, references] = path.back();
+
+                if (references.empty()) {
+                    marks[pos] = Mark::Done;
+                    path.pop_back();
+                    continue;
+                }
+
+                const Position next = references.back();
+                references.pop_back();
+
+                if (auto [mark, inserted] = marks.try_emplace(next, Mark::InProgress); !inserted) {
+                    cycle_found = mark->second == Mark::InProgress;
+                    continue;
+                }
+
+                path.emplace_back(next, get_references(next));
+            }
+        }
+
+        profiler.CountCycleCheck(marks.size());
+        return cycle_found;
+    }
+
+    // ReadRange collects the dirty formulas IsBatchable accepts down each column of a band of rows
+    // and evaluates a run of them sharing the code at once, if it is long enough to pay for the
+    // gathering of the operands; the others are evaluated one at a time
+    constexpr int BATCH_BAND_ROWS = 64;
+    constexpr std::size_t MIN_BATCH_LANES = 32;
+
+    struct BatchLane final {
+        std::size_t index;
+        const Cell* cell;
+        const detail::FormulaImpl* formula;
+    };
+
+    // reads the operands of a batchable formula if its references all hold numbers; a formula
+    // reading another one, a text, an empty cell or #REF! is left to be evaluated on its own,
+    // so the lanes of a batch never depend on each other
+    bool GatherOperands(const FormulaProgram& program, double (&operands)[2]) noexcept {
+        for (std::size_t i = 0; i < 2; ++i) {
+            const FormulaProgram::Step step = program.code->steps[i];
+
+            if (step.op == FormulaProgram::Op::Constant) {
+                operands[i] = program.code->constants[step.operand];
+                continue;
+            }
+
+            const CellReference& reference = *program.loads[step.operand];
+            const std::optional<double> number = reference.pos.IsValid() && reference.cell != nullptr
+                ? reference.cell->GetNumber() : std::nullopt;
+
+            if (!number) {
+                return false;
+            }
+
+            operands[i] = *number;
+        }
+
+        return true;
+    }
+
+    std::size_t GetBufferIndex(Position first, Size size, Position pos, BufferLayout layout) noexcept {
+        const std::size_t row = pos.row - first.row;
+        const std::size_t col = pos.col - first.col;
+
+        return layout == BufferLayout::RowMajor ? row * size.cols + col : col * size.rows + row;
+    }
+
+    // the codes compiled separately for the same formula are equal too
+    bool HasSameCode(const FormulaProgram::Code& lhs, const FormulaProgram::Code& rhs) noexcept {
+        return &lhs == &rhs || (lhs.constants == rhs.constants && std::equal(lhs.steps.begin(), lhs.steps.end(),
+            rhs.steps.begin(), rhs.steps.end(), [](FormulaProgram::Step lhs_step, FormulaProgram::Step rhs_step) {
+                return lhs_step.op == rhs_step.op && lhs_step.operand == rhs_step.operand;
+            }));
+    }
+} // unnamed namespace
+
+bool Viewport::Contains(Position pos) const noexcept {
+    return pos.row >= first.row && pos.row < first.row + size.rows
+        && pos.col >= first.col && pos.col < first.col + size.cols;
+}
+
 Sheet::~Sheet() noexcept = default;
 
+Sheet::ViewportId Sheet::AddViewport(Position first, Size size) {
+    CheckRangeValidity(first, size);
+    viewports_.emplace_back(next_viewport_id_, Viewport{ first, size });
+
+    return next_viewport_id_++;
+}
+
+void Sheet::BeginTransaction() noexcept {
+    journal_.Begin();
+    changes_.Begin();
+}
+
+bool Sheet::CanRedo() const noexcept {
+    return journal_.CanRedo();
+}
+
+bool Sheet::CanUndo() const noexcept {
+    return journal_.CanUndo();
+}
+
 void Sheet::CheckPositionValidity(Position pos) const {
     if (!pos.IsValid()) {
         throw InvalidPositionException("Invalid position");
     }
 }
 
+void Sheet::CheckRangeValidity(Position first, Size size) const {
+    if (size.rows <= 0 || size.cols <= 0 || !first.IsValid()
+        || !Position{ first.row + size.rows - 1, first.col + size.cols - 1 }.IsValid()) {
+
+        throw InvalidPositionException("Invalid range");
+    }
+}
+
+void Sheet::Checkpoint() {
+    if (log_ == nullptr) {
+        throw std::logic_error("No edit log is open");
+    }
+
+    log_->Checkpoint(spreadsheet_);
+}
+
 void Sheet::ClearCell(Position pos) {
     CheckPositionValidity(pos);
-    auto taken_cell = spreadsheet_.find(pos);
 
-    if (taken_cell != spreadsheet_.end() && taken_cell->second != nullptr) {
-        taken_cell->second->Clear();
+    if (Cell* taken_cell = spreadsheet_.Find(pos); taken_cell != nullptr) {
+        changes_.Track(pos, taken_cell);
 
-        if (taken_cell->second->HasUpperLevel()) {
-            return;
+        const bool was_placeholder = taken_cell->IsPlaceholder();
+        std::unique_ptr<detail::Impl> previous_impl = taken_cell->Clear();
+
+        if (!was_placeholder) {
+            journal_.Record(pos, std::move(previous_impl));
+
+            if (log_ != nullptr) {
+                log_->AppendClear(pos);
+            }
         }
 
-        taken_cell->second.reset(nullptr);
+        if (!taken_cell->HasUpperLevel()) {
+            spreadsheet_.Erase(pos);
+        }
+
+        changes_.Flush(*this);
     }
 }
 
-const CellInterface* Sheet::GetCell(Position pos) const {
-    CheckPositionValidity(pos);
-    auto taken_cell = spreadsheet_.find(pos);
+void Sheet::CommitTransaction() {
+    journal_.Commit();
+    changes_.Commit(*this);
+}
+
+void Sheet::Compact() {
+    spreadsheet_.Compact();
+    text_pool_.Compact();
+}
+
+void Sheet::ClonePastedContents(Position source, Size size, Position destination, PastedContents& contents) const {
+    const int row_offset = destination.row - source.row;
+    const int col_offset = destination.col - source.col;
+
+    for (int row = 0; row < size.rows; ++row) {
+        for (int col = 0; col < size.cols; ++col) {
+            const Cell* source_cell = spreadsheet_.Find({ source.row + row, source.col + col });
+            const Position pasted_pos = { destination.row + row, destination.col + col };
+            auto impl = source_cell != nullptr ? source_cell->CloneContents(row_offset, col_offset) : nullptr;
+
+            if (impl != nullptr || spreadsheet_.Find(pasted_pos) != nullptr) {
+                contents.emplace_back(pasted_pos, std::move(impl));
+            }
+        }
+    }
+}
+
+void Sheet::CopyRange(Position source, Size size, Position destination) {
+    CheckRangeValidity(source, size);
+    CheckRangeValidity(destination, size);
+
+    PastedContents contents;
+    ClonePastedContents(source, size, destination, contents);
+    Paste(std::move(contents));
+}
 
-    if (taken_cell == spreadsheet_.end()) {
-        return nullptr;
+Cell& Sheet::CreatePlaceholder(Position pos) {
+    Cell& placeholder = spreadsheet_.Insert(pos, std::make_unique<Cell>(*this, pos));
+    placeholder.MakePlaceholder();
+
+    return placeholder;
+}
+
+void Sheet::DeleteCols(int first, int count) {
+    CheckShiftCount(count);
+    ShiftCells({ PositionShift::Axis::Cols, first, -count });
+}
+
+void Sheet::DeleteRows(int first, int count) {
+    CheckShiftCount(count);
+    ShiftCells({ PositionShift::Axis::Rows, first, -count });
+}
+
+void Sheet::FillDown(Position first, Size size) {
+    CheckRangeValidity(first, size);
+
+    PastedContents contents;
+    for (int row = 1; row < size.rows; ++row) {
+        ClonePastedContents(first, { 1, size.cols }, { first.row + row, first.col }, contents);
     }
 
-    return taken_cell->second.get();
+    Paste(std::move(contents));
+}
+
+ChangeTracker& Sheet::GetChangeTracker() noexcept {
+    return changes_;
+}
+
+const CellInterface* Sheet::GetCell(Position pos) const {
+    CheckPositionValidity(pos);
+    return spreadsheet_.Find(pos);
 }
 
 CellInterface* Sheet::GetCell(Position pos) {
     CheckPositionValidity(pos);
-    auto taken_cell = spreadsheet_.find(pos);
+    return spreadsheet_.Find(pos);
+}
+
+Size Sheet::GetPrintableSize() const noexcept {
+    return spreadsheet_.GetPrintableSize();
+}
+
+MemoryStats Sheet::GetMemoryStats() const noexcept {
+    MemoryStats stats;
+    stats.cells = spreadsheet_.GetCellCount();
+    stats.allocated_rows = spreadsheet_.GetAllocatedRowCount();
+    stats.dense_rows = spreadsheet_.GetDenseRowCount();
+    stats.storage_bytes = spreadsheet_.GetStorageBytes();
+    stats.interned_texts = text_pool_.GetSize();
+    stats.spilled_text_bytes = text_pool_.GetSpilledBytes();
+    stats.resident_spilled_text_bytes = text_pool_.GetResidentSpilledBytes();
+
+    spreadsheet_.ForEach([&stats](Position, const Cell& cell) {
+        stats.placeholders += cell.IsPlaceholder();
+        stats.formulas += cell.GetFormula() != nullptr;
+    });
+
+    return stats;
+}
 
-    if (taken_cell == spreadsheet_.end()) {
-        return nullptr;
+Profiler& Sheet::GetProfiler() noexcept {
+    return profiler_;
+}
+
+std::uint64_t Sheet::GetRevision() const noexcept {
+    return revision_;
+}
+
+SheetStats Sheet::GetStats() const noexcept {
+    return profiler_.GetStats();
+}
+
+const CellStorage& Sheet::GetStorage() const noexcept {
+    return spreadsheet_;
+}
+
+StringPool& Sheet::GetTextPool() noexcept {
+    return text_pool_;
+}
+
+ValueCache& Sheet::GetValueCache() const noexcept {
+    return value_cache_;
+}
+
+const std::vector<std::pair<Sheet::ViewportId, Viewport>>& Sheet::GetViewports() const noexcept {
+    return viewports_;
+}
+
+void Sheet::InsertCols(int before, int count) {
+    CheckShiftCount(count);
+    ShiftCells({ PositionShift::Axis::Cols, before, count });
+}
+
+void Sheet::InsertRows(int before, int count) {
+    CheckShiftCount(count);
+    ShiftCells({ PositionShift::Axis::Rows, before, count });
+}
+
+void Sheet::LogContents(Position pos) {
+    if (log_ == nullptr) {
+        return;
     }
 
-    return taken_cell->second.get();
+    if (const Cell* taken_cell = spreadsheet_.Find(pos); taken_cell != nullptr && !taken_cell->IsPlaceholder()) {
+        log_->AppendSet(pos, taken_cell->GetTextView());
+    }
+    else {
+        log_->AppendClear(pos);
+    }
 }
 
-Size Sheet::GetPrintableSize() const noexcept {
-    int row_size = 0;
-    int col_size = 0;
+void Sheet::MoveViewport(ViewportId id, Position first, Size size) {
+    CheckRangeValidity(first, size);
 
-    if (spreadsheet_.empty()) {
-        return { row_size, col_size };
+    for (auto& [viewport_id, viewport] : viewports_) {
+        if (viewport_id == id) {
+            viewport = { first, size };
+        }
     }
+}
 
-    for (const auto& [pos, cell] : spreadsheet_) {
-        if (cell != nullptr) {
-            if (row_size <= pos.row) {
-                row_size = pos.row + 1;
-            }
-            
-            if (col_size <= pos.col) {
-                col_size = pos.col + 1;
-            }
+std::uint64_t Sheet::NextRevision() noexcept {
+    return ++revision_;
+}
+
+void Sheet::OpenLog(const std::string& directory, EditLog::Options options) {
+    if (log_ != nullptr) {
+        throw std::logic_error("An edit log is already open");
+    }
+    if (spreadsheet_.GetCellCount() != 0) {
+        throw std::logic_error("The edit log may only be replayed onto an empty sheet");
+    }
+
+    auto log = std::make_unique<EditLog>(directory, options);
+    Replay(log->ReadBack());
+    // the recovered state is where the history starts
+    journal_.Clear();
+
+    // restarts the log past a torn tail, and from the replayed state
+    log->Checkpoint(spreadsheet_);
+    log_ = std::move(log);
+}
+
+void Sheet::Paste(PastedContents contents) {
+    PastedImpls pasted;
+    pasted.reserve(contents.size());
+
+    for (const auto& [pos, impl] : contents) {
+        pasted.emplace(pos, impl.get());
+    }
+
+    if (HasPastedCycle(spreadsheet_, pasted, profiler_)) {
+        throw CircularDependencyException("Cyclic dependency was met.");
+    }
+
+    std::vector<Cell*> pasted_cells;
+    pasted_cells.reserve(contents.size());
+    journal_.Begin();
+    changes_.Begin();
+
+    for (auto& [pos, impl] : contents) {
+        if (impl == nullptr) {
+            ClearCell(pos);
+            continue;
+        }
+
+        Cell* taken_cell = spreadsheet_.Find(pos);
+        changes_.Track(pos, taken_cell);
+
+        if (taken_cell == nullptr) {
+            taken_cell = &spreadsheet_.Insert(pos, std::make_unique<Cell>(*this, pos));
+        }
+
+        // a pasted cell is no placeholder, so pasting the following ones never erases it
+        const bool was_placeholder = taken_cell->IsPlaceholder();
+        std::unique_ptr<detail::Impl> previous_impl = taken_cell->SetContents(std::move(impl));
+        journal_.Record(pos, was_placeholder ? nullptr : std::move(previous_impl));
+        pasted_cells.push_back(taken_cell);
+
+        if (log_ != nullptr) {
+            log_->AppendSet(pos, taken_cell->GetTextView());
         }
     }
 
-    return { row_size, col_size };
+    journal_.Commit();
+    profiler_.CountInvalidation(Cell::InvalidateDependents(pasted_cells));
+    changes_.Commit(*this);
 }
 
 void Sheet::PrintTexts(std::ostream& output) const noexcept {
@@ -94,12 +453,8 @@ void Sheet::PrintTexts(std::ostream& output) const noexcept {
 
     for (int i = 0; i < size.rows; ++i) {
         for (int j = 0; j < size.cols; ++j) {
-            Position pos = { i, j };
-
-            auto taken_cell = spreadsheet_.find(pos);
-
-            if (taken_cell != spreadsheet_.end() && taken_cell->second != nullptr) {
-                output << taken_cell->second->GetText();
+            if (const Cell* taken_cell = spreadsheet_.Find({ i, j }); taken_cell != nullptr) {
+                output << taken_cell->GetTextView();
             }
 
             if (j != size.cols - 1) {
@@ -116,17 +471,13 @@ void Sheet::PrintValues(std::ostream& output) const {
 
     for (int i = 0; i < size.rows; ++i) {
         for (int j = 0; j < size.cols; ++j) {
-            Position pos = { i, j };
-
-            auto taken_cell = spreadsheet_.find(pos);
-
-            if (taken_cell != spreadsheet_.end() && taken_cell->second != nullptr) {
+            if (const Cell* taken_cell = spreadsheet_.Find({ i, j }); taken_cell != nullptr) {
                 detail::Visitor visitor;
 
-                std::visit([&output, &taken_cell, &visitor](auto&& value) {
+                std::visit([&output, &visitor](auto&& value) {
                     visitor(output, value);
                 },
-                    taken_cell->second->GetValue());
+                    taken_cell->GetValueView());
             }
 
             if (j != size.cols - 1) {
@@ -138,14 +489,470 @@ void Sheet::PrintValues(std::ostream& output) const {
     }
 }
 
+void Sheet::PublishSnapshot() {
+    std::vector<std::pair<Position, SheetSnapshot::CellEntry>> cells;
+    cells.reserve(spreadsheet_.GetCellCount());
+
+    // the storage is traversed in row-major order, so the cells come out sorted
+    spreadsheet_.ForEach([&cells](Position pos, const Cell& cell) {
+        cells.emplace_back(pos, SheetSnapshot::CellEntry{ cell.GetText(), cell.GetValue() });
+    });
+
+    snapshots_.Publish(std::make_unique<const SheetSnapshot>(++snapshot_version_, std::move(cells)));
+}
+
+SnapshotPublisher::ReadGuard Sheet::ReadSnapshot() const noexcept {
+    return snapshots_.Read();
+}
+
+void Sheet::ReadRange(Position first, Size size, double* values, ValueKind* kinds, BufferLayout layout) const {
+    CheckRangeValidity(first, size);
+
+    const std::size_t count = static_cast<std::size_t>(size.rows) * size.cols;
+    std::fill_n(values, count, 0.0);
+
+    if (kinds != nullptr) {
+        std::fill_n(kinds, count, ValueKind::Empty);
+    }
+
+    const auto store = [&](std::size_t index, ValueKind kind, double value) {
+        values[index] = value;
+
+        if (kinds != nullptr) {
+            kinds[index] = kind;
+        }
+    };
+
+    const auto read = [&](std::size_t index, const Cell& cell) {
+        if (const std::optional<double> number = cell.GetNumber()) {
+            store(index, ValueKind::Number, *number);
+            return;
+        }
+
+        const Cell::ValueView value = cell.GetValueView();
+
+        if (const double* computed = std::get_if<double>(&value)) {
+            store(index, ValueKind::Number, *computed);
+        }
+        else {
+            const ValueKind kind = std::holds_alternative<std::string_view>(value) ? ValueKind::Text : ValueKind::Error;
+            store(index, kind, std::numeric_limits<double>::quiet_NaN());
+        }
+    };
+
+    // the dirty formulas of each column of a band, to be evaluated in batches
+    std::vector<std::vector<BatchLane>> columns(size.cols);
+    std::vector<BatchLane> batch;
+    std::vector<double> lhs;
+    std::vector<double> rhs;
+    std::vector<double> results;
+    const int end_row = std::min(first.row + size.rows, spreadsheet_.GetRowEnd());
+
+    for (int band_row = first.row; band_row < end_row; band_row += BATCH_BAND_ROWS) {
+        const Size band{ std::min(BATCH_BAND_ROWS, end_row - band_row), size.cols };
+
+        spreadsheet_.ForEachInRange({ band_row, first.col }, band, [&](Position pos, const Cell& cell) {
+            if (cell.IsPlaceholder()) {
+                return;
+            }
+
+            const std::size_t index = GetBufferIndex(first, size, pos, layout);
+
+            if (const detail::FormulaImpl* formula = cell.GetFormula();
+                formula != nullptr && formula->IsDirty() && IsBatchable(*formula->GetProgram().code)) {
+
+                columns[pos.col - first.col].push_back({ index, &cell, formula });
+            }
+            else {
+                read(index, cell);
+            }
+        });
+
+        for (std::vector<BatchLane>& lanes : columns) {
+            for (auto run_begin = lanes.begin(); run_begin != lanes.end();) {
+                const FormulaProgram::Code& code = *run_begin->formula->GetProgram().code;
+                const auto run_end = std::find_if(run_begin, lanes.end(), [&code](const BatchLane& lane) {
+                    return !HasSameCode(*lane.formula->GetProgram().code, code);
+                });
+
+                if (static_cast<std::size_t>(run_end - run_begin) < MIN_BATCH_LANES) {
+                    std::for_each(run_begin, run_end, [&](const BatchLane& lane) {
+                        read(lane.index, *lane.cell);
+                    });
+
+                    run_begin = run_end;
+                    continue;
+                }
+
+                batch.clear();
+                lhs.clear();
+                rhs.clear();
+
+                for (auto lane = run_begin; lane != run_end; ++lane) {
+                    if (double operands[2]; GatherOperands(lane->formula->GetProgram(), operands)) {
+                        batch.push_back(*lane);
+                        lhs.push_back(operands[0]);
+                        rhs.push_back(operands[1]);
+                    }
+                    else {
+                        read(lane->index, *lane->cell);
+                    }
+                }
+
+                if (batch.size() < MIN_BATCH_LANES) {
+                    for (const BatchLane& lane : batch) {
+                        read(lane.index, *lane.cell);
+                    }
+                }
+                else {
+                    results.resize(batch.size());
+                    EvaluateBatch(code, lhs.data(), rhs.data(), batch.size(), results.data());
+
+                    for (std::size_t i = 0; i < batch.size(); ++i) {
+                        // another reader may have evaluated the formula meanwhile
+                        if (!batch[i].formula->TryClaim()) {
+                            read(batch[i].index, *batch[i].cell);
+                        }
+                        else if (std::isfinite(results[i])) {
+                            batch[i].formula->Publish(results[i]);
+                            value_cache_.Touch(*batch[i].cell);
+                            store(batch[i].index, ValueKind::Number, results[i]);
+                        }
+                        else {
+                            batch[i].formula->Publish(FormulaError(FormulaError::Category::Arithmetic));
+                            value_cache_.Touch(*batch[i].cell);
+                            store(batch[i].index, ValueKind::Error, std::numeric_limits<double>::quiet_NaN());
+                        }
+                    }
+                }
+
+                run_begin = run_end;
+            }
+
+            lanes.clear();
+        }
+    }
+}
+
+void Sheet::ReadTextRange(Position first, Size size, std::string_view* texts, BufferLayout layout) const {
+    CheckRangeValidity(first, size);
+    std::fill_n(texts, static_cast<std::size_t>(size.rows) * size.cols, std::string_view{});
+
+    spreadsheet_.ForEachInRange(first, size, [&](Position pos, const Cell& cell) {
+        const std::string_view text = cell.GetTextView();
+
+        // spares evaluating formulas, which never result in a text
+        if (cell.IsPlaceholder() || cell.GetNumber().has_value() || (text.size() > 1 && text.front() == FORMULA_SIGN)) {
+            return;
+        }
+
+        if (const Cell::ValueView value = cell.GetValueView(); std::holds_alternative<std::string_view>(value)) {
+            texts[GetBufferIndex(first, size, pos, layout)] = std::get<std::string_view>(value);
+        }
+    });
+}
+
+bool Sheet::Redo() {
+    if (journal_.IsInTransaction()) {
+        throw std::logic_error("Cannot redo inside a transaction");
+    }
+
+    if (auto transaction = journal_.TakeRedo()) {
+        journal_.PushUndo(Restore(std::move(*transaction)));
+        changes_.Flush(*this);
+        return true;
+    }
+
+    return false;
+}
+
+void Sheet::ReleasePlaceholder(Position pos) {
+    spreadsheet_.Erase(pos);
+}
+
+void Sheet::RemoveViewport(ViewportId id) {
+    viewports_.erase(std::remove_if(viewports_.begin(), viewports_.end(), [id](const auto& viewport) {
+        return viewport.first == id;
+    }), viewports_.end());
+}
+
+void Sheet::Replay(std::vector<EditLog::Record> records) {
+    PastedContents contents;
+    // a position edited again within a run keeps its last contents
+    std::unordered_map<Position, std::size_t, PositionHasher> pasted_indices;
+
+    auto paste = [&] {
+        if (!contents.empty()) {
+            Paste(std::move(contents));
+            contents.clear();
+            pasted_indices.clear();
+        }
+    };
+
+    for (EditLog::Record& record : records) {
+        std::unique_ptr<detail::Impl> impl;
+
+        switch (record.kind) {
+        case EditLog::Record::Kind::Set:
+            impl = Cell::Parse(*this, std::move(record.text));
+            break;
+        case EditLog::Record::Kind::Clear:
+            break;
+        case EditLog::Record::Kind::SetNumber:
+            impl = std::make_unique<detail::NumberImpl>(record.number);
+            break;
+        case EditLog::Record::Kind::Shift:
+            paste();
+            ShiftCells(record.shift);
+            continue;
+        }
+
+        if (auto [index, inserted] = pasted_indices.try_emplace(record.pos, contents.size()); inserted) {
+            contents.emplace_back(record.pos, std::move(impl));
+        }
+        else {
+            contents[index->second].second = std::move(impl);
+        }
+    }
+
+    paste();
+}
+
+EditJournal::Transaction Sheet::Restore(EditJournal::Transaction transaction) {
+    EditJournal::Transaction reverting;
+    reverting.reserve(transaction.size());
+
+    // a step restores a past state of the sheet, which was free of cycles, so nothing is checked;
+    // the states in between may not be, hence invalidating only once everything is restored
+    for (auto edit = transaction.rbegin(); edit != transaction.rend(); ++edit) {
+        Cell* taken_cell = spreadsheet_.Find(edit->pos);
+        changes_.Track(edit->pos, taken_cell);
+
+        if (taken_cell == nullptr) {
+            taken_cell = &spreadsheet_.Insert(edit->pos, std::make_unique<Cell>(*this, edit->pos));
+        }
+
+        const bool was_placeholder = taken_cell->IsPlaceholder();
+        std::unique_ptr<detail::Impl> previous_impl = taken_cell->SetContents(std::move(edit->contents));
+        reverting.push_back({ edit->pos, was_placeholder ? nullptr : std::move(previous_impl) });
+    }
+
+    std::vector<Cell*> restored_cells;
+    restored_cells.reserve(reverting.size());
+
+    for (const EditJournal::Edit& edit : reverting) {
+        if (Cell* taken_cell = spreadsheet_.Find(edit.pos); taken_cell != nullptr) {
+            if (taken_cell->IsPlaceholder() && !taken_cell->HasUpperLevel()) {
+                spreadsheet_.Erase(edit.pos);
+            }
+            else {
+                restored_cells.push_back(taken_cell);
+            }
+        }
+
+        LogContents(edit.pos);
+    }
+
+    profiler_.CountInvalidation(Cell::InvalidateDependents(restored_cells));
+    return reverting;
+}
+
+void Sheet::ShiftCells(const PositionShift& shift) {
+    const bool shifts_rows = shift.axis == PositionShift::Axis::Rows;
+    const int limit = shifts_rows ? Position::MAX_ROWS : Position::MAX_COLS;
+
+    if (shift.first < 0 || shift.first >= limit || shift.count == 0 || shift.first + std::abs(shift.count) > limit) {
+        throw InvalidPositionException("Invalid range of rows or columns");
+    }
+
+    if (const Size size = GetPrintableSize(); shift.count > 0 && (shifts_rows ? size.rows : size.cols) > limit - shift.count) {
+        throw InvalidPositionException("Cells would be shifted out of the sheet");
+    }
+
+    if (log_ != nullptr) {
+        log_->AppendShift(shift);
+    }
+
+    // the recorded positions would no longer match
+    journal_.Clear();
+    // formulas losing references get new values without new contents
+    NextRevision();
+
+    std::vector<Cell*> moved_cells;
+    std::unordered_set<Cell*> deleted_cells;
+
+    spreadsheet_.ForEachShifted(shift, [&](Position pos, Cell& cell) {
+        changes_.Track(pos, &cell);
+
+        if (const Position moved_pos = shift.Apply(pos); moved_pos.IsValid()) {
+            changes_.Track(moved_pos, spreadsheet_.Find(moved_pos));
+            moved_cells.push_back(&cell);
+        }
+        else {
+            deleted_cells.insert(&cell);
+        }
+    });
+
+    // every referenced position holds at least a placeholder, so the formulas
+    // to rewrite are exactly the surviving dependents of the shifted cells
+    std::unordered_set<Cell*> dependents;
+
+    auto collect_dependents = [&](const Cell* cell) {
+        for (Cell* upper_cell : cell->GetUpperLevel()) {
+            if (!deleted_cells.count(upper_cell)) {
+                dependents.insert(upper_cell);
+            }
+        }
+    };
+
+    for (const Cell* cell : moved_cells) {
+        collect_dependents(cell);
+    }
+
+    std::unordered_set<Cell*> released_candidates;
+
+    for (Cell* cell : deleted_cells) {
+        collect_dependents(cell);
+
+        for (Cell* lower_cell : cell->Detach()) {
+            if (!deleted_cells.count(lower_cell)) {
+                released_candidates.insert(lower_cell);
+            }
+        }
+    }
+
+    spreadsheet_.Shift(shift);
+
+    for (Cell* cell : moved_cells) {
+        cell->SetPosition(shift.Apply(cell->GetPosition()));
+    }
+
+    for (Cell* cell : dependents) {
+        cell->ShiftReferences(shift);
+    }
+
+    for (Cell* cell : released_candidates) {
+        if (cell->IsPlaceholder() && !cell->HasUpperLevel()) {
+            ReleasePlaceholder(cell->GetPosition());
+        }
+    }
+
+    changes_.Flush(*this);
+}
+
 void Sheet::SetCell(Position pos, std::string text) {
     CheckPositionValidity(pos);
 
-    if (!spreadsheet_.count(pos)) {
-        spreadsheet_.emplace(pos, std::make_unique<Cell>(*this));
+    if (Cell* taken_cell = spreadsheet_.Find(pos); taken_cell != nullptr) {
+        changes_.Track(pos, taken_cell);
+        const bool was_placeholder = taken_cell->IsPlaceholder();
+
+        if (std::unique_ptr<detail::Impl> previous_impl = taken_cell->Set(std::move(text)); previous_impl != nullptr) {
+            journal_.Record(pos, was_placeholder ? nullptr : std::move(previous_impl));
+            LogContents(pos);
+        }
+
+        changes_.Flush(*this);
+        return;
+    }
+
+    changes_.Track(pos, nullptr);
+
+    Cell& inserted_cell = spreadsheet_.Insert(pos, std::make_unique<Cell>(*this, pos));
+
+    try {
+        inserted_cell.Set(std::move(text));
     }
+    catch (...) {
+        // a rejected text must not leave a cell without contents behind
+        spreadsheet_.Erase(pos);
+        throw;
+    }
+
+    journal_.Record(pos, nullptr);
+    LogContents(pos);
+    changes_.Flush(*this);
+}
+
+void Sheet::SetNumber(Position pos, double number) {
+    if (!std::isfinite(number)) {
+        char text[32];
+        SetCell(pos, std::string(text, std::to_chars(text, text + sizeof(text), number).ptr));
+        return;
+    }
+
+    CheckPositionValidity(pos);
+
+    if (Cell* taken_cell = spreadsheet_.Find(pos); taken_cell != nullptr) {
+        changes_.Track(pos, taken_cell);
+        const bool was_placeholder = taken_cell->IsPlaceholder();
+
+        std::unique_ptr<detail::Impl> previous_impl = taken_cell->SetNumber(number);
+        journal_.Record(pos, was_placeholder ? nullptr : std::move(previous_impl));
+    }
+    else {
+        changes_.Track(pos, nullptr);
+        spreadsheet_.Insert(pos, std::make_unique<Cell>(*this, pos)).SetNumber(number);
+        journal_.Record(pos, nullptr);
+    }
+
+    if (log_ != nullptr) {
+        log_->AppendNumber(pos, number);
+    }
+
+    changes_.Flush(*this);
+}
+
+void Sheet::SetNumbers(Position first, Size size, const double* values) {
+    CheckRangeValidity(first, size);
+
+    BeginTransaction();
+
+    for (int row = 0; row < size.rows; ++row) {
+        for (int col = 0; col < size.cols; ++col) {
+            SetNumber({ first.row + row, first.col + col }, *values++);
+        }
+    }
+
+    CommitTransaction();
+}
+
+void Sheet::SetUndoLimit(std::size_t limit) {
+    journal_.SetLimit(limit);
+}
+
+void Sheet::SpillTexts(const std::string& directory, std::size_t resident_budget) {
+    text_pool_.SpillTo(directory, resident_budget);
+}
+
+ChangeTracker::SubscriptionId Sheet::Subscribe(ChangeTracker::Callback callback) {
+    return changes_.Subscribe(std::move(callback));
+}
+
+void Sheet::SyncLog() {
+    if (log_ == nullptr) {
+        throw std::logic_error("No edit log is open");
+    }
+
+    log_->Sync();
+}
+
+bool Sheet::Undo() {
+    if (journal_.IsInTransaction()) {
+        throw std::logic_error("Cannot undo inside a transaction");
+    }
+
+    if (auto transaction = journal_.TakeUndo()) {
+        journal_.PushRedo(Restore(std::move(*transaction)));
+        changes_.Flush(*this);
+        return true;
+    }
+
+    return false;
+}
 
-    spreadsheet_.at(pos)->Set(std::move(text));
+void Sheet::Unsubscribe(ChangeTracker::SubscriptionId id) {
+    changes_.Unsubscribe(id);
 }
 
 std::unique_ptr<SheetInterface> CreateSheet() {
@@ -1,32 +1,71 @@
 #pragma once
 
 #include <cstddef>
-#include <unordered_map>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "cell.h"
+#include "cell_storage.h"
+#include "change_tracker.h"
 #include "common.h"
+#include "edit_log.h"
+#include "journal.h"
+#include "profiler.h"
+#include "snapshot.h"
+#include "string_pool.h"
+#include "value_cache.h"
 
-struct PosComparator final {
-    using is_transparent = std::false_type;
+class Cell;
+
+namespace detail {
+    class Impl;
+} // namespace detail
 
-    bool operator()(Position lhs, Position rhs) const {
-        return lhs == rhs;
-    }
+struct MemoryStats final {
+    std::size_t cells = 0;
+    std::size_t placeholders = 0;
+    std::size_t allocated_rows = 0;
+    std::size_t dense_rows = 0;
+    // the row structures and the cell objects, without the cell contents
+    std::size_t storage_bytes = 0;
+    std::size_t interned_texts = 0;
+    std::size_t formulas = 0;
+    std::size_t spilled_text_bytes = 0;
+    // of the spilled texts, the ones not paged out since they were written
+    std::size_t resident_spilled_text_bytes = 0;
 };
 
-struct PosHasher final {
-    std::size_t operator()(Position pos) const {
-        return string_hasher_(pos.ToString());
-    }
+// what ReadRange found at a position
+enum class ValueKind : std::uint8_t {
+    // no cell, or one kept only because formulas reference it
+    Empty,
+    Number,
+    Text,
+    Error,
+};
 
-private:
-    std::hash<std::string> string_hasher_;
+// the order ReadRange and ReadTextRange fill the buffers in
+enum class BufferLayout {
+    RowMajor,
+    ColumnMajor,
 };
 
-class Cell;
+// a block of the sheet on screen, recalculated ahead of the rest
+struct Viewport final {
+    Position first;
+    Size size;
+
+    bool Contains(Position pos) const noexcept;
+};
 
 class Sheet final : public SheetInterface {
 public:
+    using ViewportId = std::uint64_t;
+
     ~Sheet() noexcept;
 
     void ClearCell(Position pos) override;
@@ -37,7 +76,134 @@ public:
     void PrintValues(std::ostream& output) const override;
     void SetCell(Position pos, std::string text) override;
 
+    // a Recalculation started afterwards evaluates the formulas in the viewports, and the ones
+    // they read, before the others
+    ViewportId AddViewport(Position first, Size size);
+    // groups the following edits into one undo step, until the matching commit
+    void BeginTransaction() noexcept;
+    bool CanRedo() const noexcept;
+    bool CanUndo() const noexcept;
+    // writes the whole sheet into a new checkpoint of the edit log, which then starts over;
+    // throws std::system_error, or std::logic_error without an open log
+    void Checkpoint();
+    void CommitTransaction();
+    // releases the capacity left behind by erased cells
+    void Compact();
+    // pastes the source block at the destination with the formula references moved along,
+    // reusing the parsed formulas; the blocks may overlap
+    void CopyRange(Position source, Size size, Position destination);
+    Cell& CreatePlaceholder(Position pos);
+    // the deleted cells vanish, formulas referencing them show #REF!; drops the undo history.
+    // Throws InvalidPositionException unless the count is positive and the rows or columns exist
+    void DeleteCols(int first, int count = 1);
+    void DeleteRows(int first, int count = 1);
+    // copies the first row of the block into the other rows
+    void FillDown(Position first, Size size);
+    ChangeTracker& GetChangeTracker() noexcept;
+    MemoryStats GetMemoryStats() const noexcept;
+    Profiler& GetProfiler() noexcept;
+    // counts the contents installed so far, for dating value changes
+    std::uint64_t GetRevision() const noexcept;
+    SheetStats GetStats() const noexcept;
+    const CellStorage& GetStorage() const noexcept;
+    StringPool& GetTextPool() noexcept;
+    // unbudgeted until given a budget
+    ValueCache& GetValueCache() const noexcept;
+    // in the order they were added
+    const std::vector<std::pair<ViewportId, Viewport>>& GetViewports() const noexcept;
+    // moves the following cells and the formula references to them; drops the undo history.
+    // Throws InvalidPositionException unless the count is positive and no cell would leave the sheet
+    void InsertCols(int before, int count = 1);
+    void InsertRows(int before, int count = 1);
+    // resizes as well, as the view scrolls or the window changes
+    void MoveViewport(ViewportId id, Position first, Size size);
+    // must not overlap with reads of the sheet
+    std::uint64_t NextRevision() noexcept;
+    // restores the sheet from the checkpoint and the edit log kept in the directory, then logs
+    // the following edits there. The logged edits are pasted in bulk, up to the row and column
+    // shifts, and checkpointed. An edit is durable once SyncLog returns, or at most about the
+    // commit delay after it was made; edits, rather than transactions, are the unit of
+    // durability. Logging never makes an edit fail: once a write failed, the following edits are
+    // no longer logged, and SyncLog reports the failure until a Checkpoint succeeds. Throws
+    // std::logic_error unless the sheet is empty and has no log yet, std::system_error if the
+    // files cannot be written
+    void OpenLog(const std::string& directory, EditLog::Options options = {});
+
+    // evaluates the sheet into a new immutable version, must be called from the writer thread
+    void PublishSnapshot();
+    // may be called from any thread, the guard keeps the latest published version alive
+    SnapshotPublisher::ReadGuard ReadSnapshot() const noexcept;
+    // fills the buffers, each holding one entry per position of the block, in one pass over the
+    // stored cells; formulas are evaluated on the way, long runs of one operation over numbers down
+    // a column in batches. Numbers and formula results go to values, texts and errors read as NaN
+    // there and empty positions as zero; kinds may be nullptr
+    void ReadRange(Position first, Size size, double* values, ValueKind* kinds,
+        BufferLayout layout = BufferLayout::RowMajor) const;
+    // the companion of ReadRange for text cells: their values, valid until the cells are modified,
+    // and empty views at the other positions
+    void ReadTextRange(Position first, Size size, std::string_view* texts,
+        BufferLayout layout = BufferLayout::RowMajor) const;
+    // reapplies the last undone step, returns whether there was one;
+    // throws std::logic_error inside a transaction
+    bool Redo();
+    void ReleasePlaceholder(Position pos);
+    void RemoveViewport(ViewportId id);
+    // stores the number unboxed, skipping the text formatting and parsing; the cell reads
+    // as the text the number is written with. Infinities and NaN are set as their texts
+    void SetNumber(Position pos, double number);
+    // sets the block row by row from the values, as one undo step
+    void SetNumbers(Position first, Size size, const double* values);
+    // the number of undo steps kept, zero (the default) disables the history
+    void SetUndoLimit(std::size_t limit);
+    // keeps the texts of the cells set from now on in a file created in the directory and mapped
+    // into memory, so that the kernel can page them out instead of running out of memory; the
+    // sheet keeps at most about the budget of them resident itself. The cells themselves stay
+    // in memory, as they are linked to each other by pointers. Throws std::system_error if the file
+    // cannot be created or the directory is kept in memory, as on tmpfs, std::logic_error if called twice
+    void SpillTexts(const std::string& directory, std::size_t resident_budget);
+    // the callback gets the positions whose values changed, and the formulas left waiting for
+    // recomputation, after each edit outside a transaction and after each outermost transaction commit
+    ChangeTracker::SubscriptionId Subscribe(ChangeTracker::Callback callback);
+    // returns once the edits made so far are durable; throws std::system_error if some were lost,
+    // std::logic_error without an open log
+    void SyncLog();
+    // restores the contents replaced by the last step, returns whether there was one;
+    // only the dependents of the restored cells are invalidated. Throws std::logic_error
+    // inside a transaction
+    bool Undo();
+    void Unsubscribe(ChangeTracker::SubscriptionId id);
+
 private:
+    // contents by destination, nullptr clears the destination
+    using PastedContents = std::vector<std::pair<Position, std::unique_ptr<detail::Impl>>>;
+
     void CheckPositionValidity(Position pos) const;
-    std::unordered_map<Position, std::unique_ptr<Cell>, PosHasher, PosComparator> spreadsheet_;
+    void CheckRangeValidity(Position first, Size size) const;
+    void ClonePastedContents(Position source, Size size, Position destination, PastedContents& contents) const;
+    // appends the contents now at the position to the edit log, if there is one
+    void LogContents(Position pos);
+    // checks all the pasted formulas for cycles at once and commits them
+    void Paste(PastedContents contents);
+    // applies the records read back from the edit log, pasting the runs between the shifts at once
+    void Replay(std::vector<EditLog::Record> records);
+    // applies the edits in reverse order, returns the edits reverting them
+    EditJournal::Transaction Restore(EditJournal::Transaction transaction);
+    // costs proportional to the moved cells and the formulas referencing them
+    void ShiftCells(const PositionShift& shift);
+
+    Profiler profiler_;
+    // declared before the cells, as they leave it on destruction
+    mutable ValueCache value_cache_{ profiler_ };
+    ChangeTracker changes_;
+    SnapshotPublisher snapshots_;
+    std::uint64_t snapshot_version_ = 0;
+    std::uint64_t revision_ = 0;
+    std::vector<std::pair<ViewportId, Viewport>> viewports_;
+    ViewportId next_viewport_id_ = 0;
+
+    // declared before the cells and the journal, as their texts are released into it on destruction
+    StringPool text_pool_;
+    EditJournal journal_;
+    CellStorage spreadsheet_;
+    std::unique_ptr<EditLog> log_;
 };
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <thread>
+
+#include "snapshot.h"
+
+SheetSnapshot::SheetSnapshot(std::uint64_t version, std::vector<std::pair<Position, CellEntry>> cells)
+    : version_(version)
+    , cells_(std::move(cells)) {
+
+    for (const auto& [pos, entry] : cells_) {
+        printable_size_.rows = std::max(printable_size_.rows, pos.row + 1);
+        printable_size_.cols = std::max(printable_size_.cols, pos.col + 1);
+    }
+}
+
+const SheetSnapshot::CellEntry* SheetSnapshot::GetCell(Position pos) const {
+    auto taken_cell = std::lower_bound(cells_.begin(), cells_.end(), pos, [](const auto& cell, Position pos) {
+        return cell.first < pos;
+    });
+
+    if (taken_cell == cells_.end() || !(taken_cell->first == pos)) {
+        return nullptr;
+    }
+
+    return &taken_cell->second;
+}
+
+Size SheetSnapshot::GetPrintableSize() const noexcept {
+    return printable_size_;
+}
+
+std::uint64_t SheetSnapshot::GetVersion() const noexcept {
+    return version_;
+}
+
+SnapshotPublisher::ReadGuard::ReadGuard(std::atomic<std::size_t>& readers, const SheetSnapshot* snapshot) noexcept
+    : readers_(readers)
+    , snapshot_(snapshot) {
+}
+
+SnapshotPublisher::ReadGuard::~ReadGuard() noexcept {
+    readers_.fetch_sub(1);
+}
+
+const SheetSnapshot& SnapshotPublisher::ReadGuard::operator*() const noexcept {
+    return *snapshot_;
+}
+
+const SheetSnapshot* SnapshotPublisher::ReadGuard::operator->() const noexcept {
+    return snapshot_;
+}
+
+SnapshotPublisher::SnapshotPublisher()
+    : current_(new SheetSnapshot()) {
+}
+
+SnapshotPublisher::~SnapshotPublisher() noexcept {
+    delete current_.load();
+}
+
+void SnapshotPublisher::Publish(std::unique_ptr<const SheetSnapshot> snapshot) {
+    const SheetSnapshot* replaced = current_.exchange(snapshot.release());
+    const std::uint64_t epoch = epoch_.fetch_add(1);
+
+    // only the readers registered in the previous epoch may still see the replaced snapshot
+    while (readers_[epoch % 2].load() != 0) {
+        std::this_thread::yield();
+    }
+
+    delete replaced;
+}
+
+SnapshotPublisher::ReadGuard SnapshotPublisher::Read() const noexcept {
+    while (true) {
+        const std::uint64_t epoch = epoch_.load();
+        std::atomic<std::size_t>& readers = readers_[epoch % 2];
+        readers.fetch_add(1);
+
+        // registration raced with a publication, the writer may not wait for this counter
+        if (epoch_.load() == epoch) {
+            return ReadGuard(readers, current_.load());
+        }
+
+        readers.fetch_sub(1);
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+
+// Immutable copy of the computed state of a sheet; safe to read from any thread.
+class SheetSnapshot final {
+public:
+    struct CellEntry final {
+        std::string text;
+        CellInterface::Value value;
+    };
+
+    SheetSnapshot() = default;
+    // the cells must be sorted by position
+    SheetSnapshot(std::uint64_t version, std::vector<std::pair<Position, CellEntry>> cells);
+
+    const CellEntry* GetCell(Position pos) const;
+    Size GetPrintableSize() const noexcept;
+    std::uint64_t GetVersion() const noexcept;
+
+private:
+    std::uint64_t version_ = 0;
+    Size printable_size_;
+    std::vector<std::pair<Position, CellEntry>> cells_;
+};
+
+// Single writer, many readers publication of snapshots.
+// Readers register in the counter of the current epoch and never block;
+// the writer swaps the pointer, advances the epoch and waits until the readers
+// of the previous epoch are gone before reclaiming the replaced snapshot.
+class SnapshotPublisher final {
+public:
+    class ReadGuard final {
+    public:
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        ~ReadGuard() noexcept;
+
+        const SheetSnapshot& operator*() const noexcept;
+        const SheetSnapshot* operator->() const noexcept;
+
+    private:
+        friend class SnapshotPublisher;
+        ReadGuard(std::atomic<std::size_t>& readers, const SheetSnapshot* snapshot) noexcept;
+
+        std::atomic<std::size_t>& readers_;
+        const SheetSnapshot* snapshot_;
+    };
+
+    SnapshotPublisher();
+    SnapshotPublisher(const SnapshotPublisher&) = delete;
+    SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+    // no read guard may outlive the publisher
+    ~SnapshotPublisher() noexcept;
+
+    // must only be called from the writer thread
+    void Publish(std::unique_ptr<const SheetSnapshot> snapshot);
+    ReadGuard Read() const noexcept;
+
+private:
+    std::atomic<const SheetSnapshot*> current_;
+    std::atomic<std::uint64_t> epoch_ = 0;
+    mutable std::array<std::atomic<std::size_t>, 2> readers_ = {};
+};
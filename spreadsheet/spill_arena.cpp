@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+#include <system_error>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/magic.h>
+#include <sys/vfs.h>
+#endif
+
+#include "spill_arena.h"
+
+namespace {
+    constexpr std::size_t CHUNK_BYTES = std::size_t(1) << 20;
+    constexpr std::size_t BLOCK_ALIGNMENT = 16;
+
+    std::size_t RoundUp(std::size_t size, std::size_t alignment) noexcept {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    [[noreturn]] void ThrowSystemError(const char* what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    // whether the files of the directory live in memory, which is only known on Linux
+    bool IsKeptInMemory(const std::string& directory) noexcept {
+#if defined(__linux__)
+        struct statfs info;
+
+        if (::statfs(directory.c_str(), &info) == 0) {
+            return info.f_type == TMPFS_MAGIC || info.f_type == RAMFS_MAGIC;
+        }
+#else
+        static_cast<void>(directory);
+#endif
+
+        return false;
+    }
+} // unnamed namespace
+
+#if !defined(_WIN32)
+
+SpillArena::SpillArena(const std::string& directory, std::size_t resident_budget)
+    : resident_budget_(resident_budget) {
+
+    if (IsKeptInMemory(directory)) {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "The spill directory is kept in memory");
+    }
+
+    std::string path = directory + "/spreadsheet-spill-XXXXXX";
+    fd_ = ::mkstemp(path.data());
+
+    if (fd_ < 0) {
+        ThrowSystemError("Cannot create the spill file");
+    }
+
+    ::unlink(path.c_str());
+}
+
+SpillArena::~SpillArena() noexcept {
+    for (const Chunk& chunk : chunks_) {
+        ::munmap(chunk.data, chunk.size);
+    }
+
+    ::close(fd_);
+}
+
+void SpillArena::AddChunk(std::size_t min_size) {
+    const std::size_t size = RoundUp(std::max(min_size, CHUNK_BYTES), CHUNK_BYTES);
+
+    if (::ftruncate(fd_, static_cast<off_t>(file_bytes_ + size)) != 0) {
+        ThrowSystemError("Cannot grow the spill file");
+    }
+
+    void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, static_cast<off_t>(file_bytes_));
+
+    if (data == MAP_FAILED) {
+        ThrowSystemError("Cannot map the spill file");
+    }
+
+    // the filled chunk now counts against the budget
+    if (!chunks_.empty() && chunks_.back().resident_bytes != 0) {
+        resident_bytes_ += chunks_.back().resident_bytes;
+        resident_chunks_.push_back(chunks_.size() - 1);
+    }
+
+    chunks_.push_back({ static_cast<char*>(data), size, file_bytes_ });
+    chunk_indices_.emplace(chunks_.back().data, chunks_.size() - 1);
+    file_bytes_ += size;
+
+    // the rest of the previous chunk is left unused
+    free_begin_ = static_cast<char*>(data);
+    free_end_ = free_begin_ + size;
+}
+
+void SpillArena::PageOut(Chunk& chunk) noexcept {
+    // dirty pages are written back first, so that both the mapping and the page cache may drop them
+    ::msync(chunk.data, chunk.size, MS_SYNC);
+    ::madvise(chunk.data, chunk.size, MADV_DONTNEED);
+#if defined(POSIX_FADV_DONTNEED)
+    ::posix_fadvise(fd_, static_cast<off_t>(chunk.file_offset), static_cast<off_t>(chunk.size), POSIX_FADV_DONTNEED);
+#endif
+}
+
+#else
+
+SpillArena::SpillArena(const std::string& /* directory */, std::size_t resident_budget)
+    : resident_budget_(resident_budget) {
+
+    throw std::system_error(std::make_error_code(std::errc::function_not_supported), "Cannot create the spill file");
+}
+
+SpillArena::~SpillArena() noexcept = default;
+
+void SpillArena::AddChunk(std::size_t /* min_size */) {
+}
+
+void SpillArena::PageOut(Chunk& /* chunk */) noexcept {
+}
+
+#endif
+
+char* SpillArena::Allocate(std::size_t size) {
+    const std::size_t block_size = RoundUp(std::max<std::size_t>(size, 1), BLOCK_ALIGNMENT);
+    char* block = nullptr;
+
+    if (auto blocks = free_blocks_.find(block_size); blocks != free_blocks_.end() && !blocks->second.empty()) {
+        block = blocks->second.back();
+        blocks->second.pop_back();
+        MarkResident(std::prev(chunk_indices_.upper_bound(block))->second, block_size);
+    }
+    else {
+        if (static_cast<std::size_t>(free_end_ - free_begin_) < block_size) {
+            AddChunk(block_size);
+        }
+
+        block = free_begin_;
+        free_begin_ += block_size;
+        MarkResident(chunks_.size() - 1, block_size);
+    }
+
+    allocated_bytes_ += block_size;
+
+    if (resident_bytes_ > resident_budget_) {
+        EnforceBudget();
+    }
+
+    return block;
+}
+
+void SpillArena::EnforceBudget() noexcept {
+    while (resident_bytes_ > resident_budget_ && !resident_chunks_.empty()) {
+        Chunk& chunk = chunks_[resident_chunks_.front()];
+        resident_chunks_.pop_front();
+
+        PageOut(chunk);
+        resident_bytes_ -= chunk.resident_bytes;
+        chunk.resident_bytes = 0;
+    }
+}
+
+void SpillArena::Free(char* block, std::size_t size) noexcept {
+    const std::size_t block_size = RoundUp(std::max<std::size_t>(size, 1), BLOCK_ALIGNMENT);
+    allocated_bytes_ -= block_size;
+
+    try {
+        free_blocks_[block_size].push_back(block);
+    }
+    catch (...) {
+        // the block is only lost for reuse
+    }
+}
+
+std::size_t SpillArena::GetAllocatedBytes() const noexcept {
+    return allocated_bytes_;
+}
+
+std::size_t SpillArena::GetFileBytes() const noexcept {
+    return file_bytes_;
+}
+
+std::size_t SpillArena::GetResidentBytes() const noexcept {
+    return resident_bytes_ + (chunks_.empty() ? 0 : chunks_.back().resident_bytes);
+}
+
+void SpillArena::MarkResident(std::size_t chunk, std::size_t size) {
+    const bool was_paged_out = chunks_[chunk].resident_bytes == 0;
+    chunks_[chunk].resident_bytes += size;
+
+    // the chunk being filled joins the others once the next one is added
+    if (chunk + 1 != chunks_.size()) {
+        resident_bytes_ += size;
+
+        if (was_paged_out) {
+            resident_chunks_.push_back(chunk);
+        }
+    }
+}
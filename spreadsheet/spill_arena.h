@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Memory for immutable data that may live out of core: blocks carved from a backing file
+// mapped into the address space. The file is removed as soon as it is created, so it goes
+// with the process. Its pages belong to the page cache, so under memory pressure the kernel
+// writes them back and drops them instead of swapping or failing, and they are read back in
+// on access. The arena also counts the bytes written into each chunk of the file since it was
+// last paged out; while the chunks other than the one being filled hold more than the resident
+// budget of them, it writes the oldest back and evicts them from the page cache. Pages read
+// back in afterwards are clean, so the kernel drops them again without writing anything.
+// Blocks never move. Supported on POSIX systems only; the directory must not be kept in memory,
+// as on tmpfs, where paging out would save nothing.
+class SpillArena final {
+public:
+    // throws std::system_error if the file cannot be created or the directory is kept in memory
+    SpillArena(const std::string& directory, std::size_t resident_budget);
+    SpillArena(const SpillArena&) = delete;
+    SpillArena& operator=(const SpillArena&) = delete;
+    // no block may be used afterwards
+    ~SpillArena() noexcept;
+
+    char* Allocate(std::size_t size);
+    // the size must be the one the block was allocated with
+    void Free(char* block, std::size_t size) noexcept;
+
+    // the blocks handed out and not freed, rounded up to their size classes
+    std::size_t GetAllocatedBytes() const noexcept;
+    std::size_t GetFileBytes() const noexcept;
+    // the bytes written since their chunks were last paged out, the chunk being filled included
+    std::size_t GetResidentBytes() const noexcept;
+
+private:
+    struct Chunk final {
+        char* data;
+        std::size_t size;
+        std::size_t file_offset;
+        // written since the chunk was last paged out
+        std::size_t resident_bytes = 0;
+    };
+
+    void AddChunk(std::size_t min_size);
+    // pages out the oldest chunks written to until the others fit the budget
+    void EnforceBudget() noexcept;
+    // counts a block written into a chunk
+    void MarkResident(std::size_t chunk, std::size_t size);
+    // writes the chunk back and evicts it from the page cache
+    void PageOut(Chunk& chunk) noexcept;
+
+    int fd_ = -1;
+    std::size_t resident_budget_;
+    std::vector<Chunk> chunks_;
+    // chunk indices by their first byte, to find the chunk of a reused block
+    std::map<const char*, std::size_t> chunk_indices_;
+    // the freed blocks by size class, reused before the file grows
+    std::unordered_map<std::size_t, std::vector<char*>> free_blocks_;
+    char* free_begin_ = nullptr;
+    char* free_end_ = nullptr;
+    std::size_t file_bytes_ = 0;
+    std::size_t allocated_bytes_ = 0;
+    // of the chunks other than the last one, which are queued oldest first
+    std::size_t resident_bytes_ = 0;
+    std::deque<std::size_t> resident_chunks_;
+};
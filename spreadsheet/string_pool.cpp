@@ -0,0 +1,67 @@
+#include <stdexcept>
+
+#include "string_pool.h"
+
+struct StringPool::Entry final {
+    // empty for a text kept in the spill arena
+    std::string storage;
+    std::string_view text;
+};
+
+void StringPool::Compact() {
+    pool_.rehash(0);
+}
+
+std::size_t StringPool::GetResidentSpilledBytes() const noexcept {
+    return spill_ != nullptr ? spill_->GetResidentBytes() : 0;
+}
+
+std::size_t StringPool::GetSize() const noexcept {
+    return pool_.size();
+}
+
+std::size_t StringPool::GetSpilledBytes() const noexcept {
+    return spill_ != nullptr ? spill_->GetAllocatedBytes() : 0;
+}
+
+StringPool::Handle StringPool::Intern(std::string_view text) {
+    if (auto taken_entry = pool_.find(text); taken_entry != pool_.end()) {
+        const std::shared_ptr<const Entry> entry = taken_entry->second.lock();
+        return Handle(entry, &entry->text);
+    }
+
+    auto entry = std::make_unique<Entry>();
+    SpillArena* spill = text.empty() ? nullptr : spill_.get();
+
+    if (spill != nullptr) {
+        char* block = spill_->Allocate(text.size());
+        text.copy(block, text.size());
+        entry->text = std::string_view(block, text.size());
+    }
+    else {
+        entry->storage = text;
+        entry->text = entry->storage;
+    }
+
+    std::shared_ptr<const Entry> shared_entry(entry.release(), [this, spill](const Entry* released_entry) {
+        pool_.erase(released_entry->text);
+
+        if (spill != nullptr) {
+            spill->Free(const_cast<char*>(released_entry->text.data()), released_entry->text.size());
+        }
+
+        delete released_entry;
+    });
+
+    pool_.emplace(shared_entry->text, shared_entry);
+    return Handle(shared_entry, &shared_entry->text);
+}
+
+void StringPool::SpillTo(const std::string& directory, std::size_t resident_budget) {
+    // the texts in the current arena would be unmapped under their handles
+    if (spill_ != nullptr) {
+        throw std::logic_error("The texts are already spilled");
+    }
+
+    spill_ = std::make_unique<SpillArena>(directory, resident_budget);
+}
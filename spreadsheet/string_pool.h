@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "spill_arena.h"
+
+// Sheet-wide storage of immutable cell texts: equal texts share one allocation.
+// An entry lives while at least one handle to it exists, so the pool must outlive every handle.
+class StringPool final {
+public:
+    using Handle = std::shared_ptr<const std::string_view>;
+
+    StringPool() = default;
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+    ~StringPool() noexcept = default;
+
+    void Compact();
+    // the bytes of the spilled texts written since their pages were last handed back to the disk
+    std::size_t GetResidentSpilledBytes() const noexcept;
+    std::size_t GetSize() const noexcept;
+    // the bytes of the texts kept in the spill arena
+    std::size_t GetSpilledBytes() const noexcept;
+    Handle Intern(std::string_view text);
+    // the texts interned from now on are kept in a spill arena, see SpillArena; may only be called
+    // once, throws std::logic_error afterwards
+    void SpillTo(const std::string& directory, std::size_t resident_budget);
+
+private:
+    struct Entry;
+
+    std::unordered_map<std::string_view, std::weak_ptr<const Entry>> pool_;
+    std::unique_ptr<SpillArena> spill_;
+};
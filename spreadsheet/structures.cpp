@@ -1,11 +1,11 @@
 #include <algorithm>
 #include <cctype>
+#include <charconv>
 #include <sstream>
 
 #include "common.h"
 
 const int LETTERS = 26;
-const int MAX_POSITION_LENGTH = 17;
 const int MAX_POS_LETTER_COUNT = 3;
 
 const Position Position::NONE = { -1, -1 };
@@ -22,22 +22,29 @@ bool Position::IsValid() const noexcept {
     return row >= 0 && col >= 0 && row < MAX_ROWS && col < MAX_COLS;
 }
 
-std::string Position::ToString() const {
+std::size_t Position::ToChars(char* buffer) const noexcept {
     if (!IsValid()) {
-        return "";
+        return 0;
     }
 
-    std::string result;
-    result.reserve(MAX_POSITION_LENGTH);
-    int c = col;
+    std::size_t letter_count = 0;
+    for (int c = col; c >= 0; c = c / LETTERS - 1) {
+        ++letter_count;
+    }
 
-    while (c >= 0) {
-        result.insert(result.begin(), 'A' + c % LETTERS);
+    int c = col;
+    for (std::size_t i = letter_count; i > 0; --i) {
+        buffer[i - 1] = static_cast<char>('A' + c % LETTERS);
         c = c / LETTERS - 1;
     }
 
-    result += std::to_string(row + 1);
-    return result;
+    auto [end, ec] = std::to_chars(buffer + letter_count, buffer + MAX_POSITION_LENGTH, row + 1);
+    return end - buffer;
+}
+
+std::string Position::ToString() const {
+    char buffer[MAX_POSITION_LENGTH];
+    return std::string(buffer, ToChars(buffer));
 }
 
 Position Position::FromString(std::string_view str) {
@@ -75,6 +82,29 @@ Position Position::FromString(std::string_view str) {
     return { row - 1, col - 1 };
 }
 
+std::size_t PositionHasher::operator()(Position pos) const noexcept {
+    return static_cast<std::size_t>(pos.row) * Position::MAX_COLS + pos.col;
+}
+
+bool PositionShift::Affects(Position pos) const noexcept {
+    return (axis == Axis::Rows ? pos.row : pos.col) >= first;
+}
+
+Position PositionShift::Apply(Position pos) const noexcept {
+    if (!pos.IsValid() || !Affects(pos)) {
+        return pos;
+    }
+
+    int& coordinate = axis == Axis::Rows ? pos.row : pos.col;
+
+    if (count < 0 && coordinate < first - count) {
+        return Position::NONE;
+    }
+
+    coordinate += count;
+    return pos.IsValid() ? pos : Position::NONE;
+}
+
 bool Size::operator==(Size rhs) const noexcept {
     return cols == rhs.cols && rows == rhs.rows;
 }
\ No newline at end of file
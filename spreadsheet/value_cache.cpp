@@ -0,0 +1,124 @@
+#include "value_cache.h"
+
+#include "cell.h"
+#include "profiler.h"
+
+ValueCache::ValueCache(Profiler& profiler)
+    : profiler_(profiler) {
+}
+
+void ValueCache::Forget(const Cell& cell) noexcept {
+    if (budget_.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    std::lock_guard guard(mutex_);
+
+    if (auto it = slots_.find(&cell); it != slots_.end()) {
+        Remove(it->second);
+    }
+}
+
+std::size_t ValueCache::GetBudget() const noexcept {
+    return budget_.load(std::memory_order_relaxed);
+}
+
+std::size_t ValueCache::GetSize() const {
+    std::lock_guard guard(mutex_);
+    return ring_.size();
+}
+
+void ValueCache::SetBudget(std::size_t budget) {
+    std::lock_guard guard(mutex_);
+    budget_.store(budget, std::memory_order_relaxed);
+
+    if (budget == 0) {
+        ring_.clear();
+        slots_.clear();
+        hand_ = 0;
+        return;
+    }
+
+    while (ring_.size() > budget) {
+        const std::optional<std::size_t> victim = FindVictim();
+
+        if (!victim) {
+            break;
+        }
+
+        Remove(*victim);
+    }
+}
+
+std::optional<std::size_t> ValueCache::FindVictim() {
+    // a full sweep clears every reference bit, so the second one only meets hot formulas
+    for (std::size_t step = 0; step < 2 * ring_.size(); ++step, hand_ = (hand_ + 1) % ring_.size()) {
+        Entry& entry = ring_[hand_];
+        const detail::FormulaImpl* formula = entry.cell->GetFormula();
+
+        // the formula was replaced or invalidated since it was admitted, which frees the slot as well
+        if (formula == nullptr || !formula->IsCurrent()) {
+            return hand_;
+        }
+
+        if (entry.referenced) {
+            entry.referenced = false;
+        }
+        else if (entry.cell->GetUpperLevel().size() < HOT_DEPENDENTS) {
+            if (formula->Evict()) {
+                profiler_.CountEviction();
+            }
+
+            return hand_;
+        }
+    }
+
+    return std::nullopt;
+}
+
+void ValueCache::Remove(std::size_t slot) noexcept {
+    slots_.erase(ring_[slot].cell);
+
+    if (slot + 1 != ring_.size()) {
+        ring_[slot] = ring_.back();
+        slots_[ring_[slot].cell] = slot;
+    }
+
+    ring_.pop_back();
+
+    if (hand_ >= ring_.size()) {
+        hand_ = 0;
+    }
+}
+
+void ValueCache::TouchSlow(const Cell& cell) {
+    if (cell.GetFormula() == nullptr) {
+        return;
+    }
+
+    std::lock_guard guard(mutex_);
+    const std::size_t budget = budget_.load(std::memory_order_relaxed);
+
+    if (budget == 0) {
+        return;
+    }
+
+    if (auto it = slots_.find(&cell); it != slots_.end()) {
+        ring_[it->second].referenced = true;
+        return;
+    }
+
+    // the new formula takes the slot of the victim, right behind the hand
+    if (ring_.size() >= budget) {
+        if (const std::optional<std::size_t> victim = FindVictim()) {
+            slots_.erase(ring_[*victim].cell);
+            ring_[*victim] = { &cell, true };
+            slots_.emplace(&cell, *victim);
+            hand_ = (*victim + 1) % ring_.size();
+            return;
+        }
+    }
+
+    slots_.emplace(&cell, ring_.size());
+    ring_.push_back({ &cell, true });
+}
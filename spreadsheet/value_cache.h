@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+class Cell;
+class Profiler;
+
+// An optional budget on the formula values the sheet keeps cached. A formula is admitted when
+// its value is read and evicted by the CLOCK algorithm: the hand sweeps the ring of cached
+// formulas, sparing the ones read since it last passed and the hot ones, which feed at least
+// HOT_DEPENDENTS others, and evicts the first one left. An evicted formula keeps its value for
+// the comparisons dating it, but is evaluated again when read. Without a budget every hook
+// returns right away; with one, reads serialize on the ring.
+class ValueCache final {
+public:
+    static constexpr std::size_t HOT_DEPENDENTS = 8;
+
+    explicit ValueCache(Profiler& profiler);
+    ValueCache(const ValueCache&) = delete;
+    ValueCache& operator=(const ValueCache&) = delete;
+
+    // the cell is going away
+    void Forget(const Cell& cell) noexcept;
+    // zero when the values are not budgeted
+    std::size_t GetBudget() const noexcept;
+    // the formulas admitted and not evicted since
+    std::size_t GetSize() const;
+    // zero keeps every value and forgets the ring; a smaller budget evicts at once, as far as
+    // the hot formulas allow
+    void SetBudget(std::size_t budget);
+    // the value of the formula in the cell was read, and is current
+    void Touch(const Cell& cell);
+
+private:
+    struct Entry final {
+        const Cell* cell;
+        // read since the hand last passed
+        bool referenced;
+    };
+
+    // advances the hand to the slot of a formula evicted, or no longer cached anyway; none if
+    // only hot formulas are left
+    std::optional<std::size_t> FindVictim();
+    void Remove(std::size_t slot) noexcept;
+    void TouchSlow(const Cell& cell);
+
+    Profiler& profiler_;
+    std::atomic<std::size_t> budget_ = 0;
+
+    mutable std::mutex mutex_;
+    std::vector<Entry> ring_;
+    std::unordered_map<const Cell*, std::size_t> slots_;
+    std::size_t hand_ = 0;
+};
+
+inline void ValueCache::Touch(const Cell& cell) {
+    if (budget_.load(std::memory_order_relaxed) != 0) {
+        TouchSlow(cell);
+    }
+}